@@ -0,0 +1,304 @@
+/*
+ *  Raw Bayer to BGR24
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+#include "bayer.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+enum { R, G, B };
+
+static const struct {
+	__u32		pixelformat;
+	unsigned int	bits;
+	int		packed;
+	const char	*order;		/* first two rows */
+} formats[] = {
+	{ V4L2_PIX_FMT_SBGGR8,   8,  0, "BGGR" },
+	{ V4L2_PIX_FMT_SGBRG8,   8,  0, "GBRG" },
+	{ V4L2_PIX_FMT_SGRBG8,   8,  0, "GRBG" },
+	{ V4L2_PIX_FMT_SRGGB8,   8,  0, "RGGB" },
+	{ V4L2_PIX_FMT_SBGGR10,  10, 0, "BGGR" },
+	{ V4L2_PIX_FMT_SGBRG10,  10, 0, "GBRG" },
+	{ V4L2_PIX_FMT_SGRBG10,  10, 0, "GRBG" },
+	{ V4L2_PIX_FMT_SRGGB10,  10, 0, "RGGB" },
+	{ V4L2_PIX_FMT_SBGGR10P, 10, 1, "BGGR" },
+	{ V4L2_PIX_FMT_SGBRG10P, 10, 1, "GBRG" },
+	{ V4L2_PIX_FMT_SGRBG10P, 10, 1, "GRBG" },
+	{ V4L2_PIX_FMT_SRGGB10P, 10, 1, "RGGB" },
+	{ V4L2_PIX_FMT_SBGGR12,  12, 0, "BGGR" },
+	{ V4L2_PIX_FMT_SGBRG12,  12, 0, "GBRG" },
+	{ V4L2_PIX_FMT_SGRBG12,  12, 0, "GRBG" },
+	{ V4L2_PIX_FMT_SRGGB12,  12, 0, "RGGB" },
+	{ V4L2_PIX_FMT_SBGGR12P, 12, 1, "BGGR" },
+	{ V4L2_PIX_FMT_SGBRG12P, 12, 1, "GBRG" },
+	{ V4L2_PIX_FMT_SGRBG12P, 12, 1, "GRBG" },
+	{ V4L2_PIX_FMT_SRGGB12P, 12, 1, "RGGB" },
+};
+
+#define N_FORMATS	(sizeof(formats) / sizeof(formats[0]))
+
+static int lookup(__u32 pixelformat)
+{
+	unsigned int i;
+
+	for (i = 0; i < N_FORMATS; i++)
+		if (formats[i].pixelformat == pixelformat)
+			return i;
+	return -1;
+}
+
+int bayer_supported(__u32 pixelformat)
+{
+	return lookup(pixelformat) >= 0;
+}
+
+unsigned int bayer_min_stride(__u32 pixelformat, unsigned int width)
+{
+	int f = lookup(pixelformat);
+
+	if (f < 0)
+		return 0;
+	if (8 == formats[f].bits)
+		return width;
+	if (formats[f].packed)
+		return width * formats[f].bits / 8;
+	return width * 2;
+}
+
+int bayer_init(struct bayer *b, const struct v4l2_pix_format *pix)
+{
+	unsigned int min;
+	int i, f = lookup(pix->pixelformat);
+
+	CLEAR(*b);
+	if (f < 0 || pix->width < 2 || pix->height < 2)
+		return -1;
+
+	b->width = pix->width;
+	b->height = pix->height;
+	b->bits = formats[f].bits;
+	b->packed = formats[f].packed;
+	for (i = 0; i < 4; i++)
+		b->cfa[i] = 'R' == formats[f].order[i] ? R :
+			    'B' == formats[f].order[i] ? B : G;
+
+	min = bayer_min_stride(pix->pixelformat, b->width);
+	b->bytesperline = pix->bytesperline < min ? min : pix->bytesperline;
+
+	b->mosaic = malloc((size_t)b->width * b->height);
+	return b->mosaic ? 0 : -1;
+}
+
+void bayer_release(struct bayer *b)
+{
+	free(b->mosaic);
+	b->mosaic = NULL;
+}
+
+/* 16-bit little-endian samples of `bits` bits to their top 8 bits */
+static void unpack16(const unsigned char *s, unsigned char *d,
+		     unsigned int n, unsigned int bits)
+{
+	const unsigned int shift = bits - 8;
+	unsigned int x = 0;
+
+#ifdef __SSE2__
+	const __m128i sh = _mm_cvtsi32_si128(shift);
+
+	for (; x + 16 <= n; x += 16) {
+		__m128i lo = _mm_loadu_si128((const __m128i *)(s + 2 * x));
+		__m128i hi = _mm_loadu_si128((const __m128i *)(s + 2 * x + 16));
+
+		lo = _mm_srl_epi16(lo, sh);
+		hi = _mm_srl_epi16(hi, sh);
+		_mm_storeu_si128((__m128i *)(d + x), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	for (; x < n; x++) {
+		unsigned int v = (s[2 * x] | s[2 * x + 1] << 8) >> shift;
+
+		d[x] = v > 255 ? 255 : v;
+	}
+}
+
+/*
+ * MIPI packing: 10-bit keeps the 8 MSBs of 4 pixels in 4 bytes and their
+ * LSBs in a 5th, 12-bit the MSBs of 2 pixels in 2 bytes and LSBs in a 3rd.
+ * Dropping to 8 bits is a gather that skips every LSB byte.
+ */
+static void unpack_packed(const unsigned char *s, unsigned char *d,
+			  unsigned int n, unsigned int bits)
+{
+	unsigned int x = 0;
+
+	if (10 == bits) {
+#ifdef __SSSE3__
+		/* 3 groups of 5 bytes per 16-byte load */
+		const __m128i gather = _mm_setr_epi8(0, 1, 2, 3, 5, 6, 7, 8,
+						     10, 11, 12, 13,
+						     -1, -1, -1, -1);
+
+		for (; x + 16 <= n; x += 12, s += 15) {
+			__m128i v = _mm_loadu_si128((const __m128i *)s);
+
+			/* 16-byte store, the last 4 are overwritten next */
+			_mm_storeu_si128((__m128i *)(d + x),
+					 _mm_shuffle_epi8(v, gather));
+		}
+#endif
+		for (; x + 4 <= n; x += 4, s += 5)
+			memcpy(d + x, s, 4);
+		for (; x < n; x++)
+			d[x] = *s++;
+	} else {
+		for (; x + 2 <= n; x += 2, s += 3) {
+			d[x] = s[0];
+			d[x + 1] = s[1];
+		}
+		if (x < n)
+			d[x] = s[0];
+	}
+}
+
+static void unpack(struct bayer *b, const unsigned char *src,
+		   unsigned int *hist)
+{
+	int y;
+
+#pragma omp parallel for schedule(static)
+	for (y = 0; y < (int)b->height; y++) {
+		const unsigned char *s = src + (size_t)y * b->bytesperline;
+		unsigned char *d = b->mosaic + (size_t)y * b->width;
+
+		if (8 == b->bits)
+			memcpy(d, s, b->width);
+		else if (b->packed)
+			unpack_packed(s, d, b->width, b->bits);
+		else
+			unpack16(s, d, b->width, b->bits);
+	}
+
+	if (hist) {
+		const unsigned char *m = b->mosaic;
+		size_t i, n = (size_t)b->width * b->height;
+
+		for (i = 0; i < n; i++)
+			hist[m[i]]++;
+	}
+}
+
+/* mirror keeps the CFA phase: -1 -> 1, n -> n - 2 */
+static inline int mirror(int i, int n)
+{
+	return i < 0 ? -i : i >= n ? 2 * n - 2 - i : i;
+}
+
+/* one pixel anywhere, edges mirrored */
+static void pixel(const struct bayer *b, int x, int y, unsigned char *d)
+{
+	const int w = b->width, h = b->height;
+	const unsigned char *m = b->mosaic;
+	int xl = mirror(x - 1, w), xr = mirror(x + 1, w);
+	int yu = mirror(y - 1, h), yd = mirror(y + 1, h);
+	int c = b->cfa[(y & 1) * 2 + (x & 1)];
+	int v[3];
+
+#define M(x, y) m[(y) * w + (x)]
+	v[c] = M(x, y);
+	if (G == c) {
+		/* colour of the horizontal neighbours */
+		int ch = b->cfa[(y & 1) * 2 + ((x + 1) & 1)];
+
+		v[ch] = (M(xl, y) + M(xr, y) + 1) >> 1;
+		v[R + B - ch] = (M(x, yu) + M(x, yd) + 1) >> 1;
+	} else {
+		v[G] = (M(xl, y) + M(xr, y) + M(x, yu) + M(x, yd) + 2) >> 2;
+		v[R + B - c] = (M(xl, yu) + M(xr, yu) +
+				M(xl, yd) + M(xr, yd) + 2) >> 2;
+	}
+#undef M
+	d[0] = v[B];
+	d[1] = v[G];
+	d[2] = v[R];
+}
+
+static void demosaic_row(const struct bayer *b, int y, unsigned char *dst)
+{
+	const int w = b->width;
+	const unsigned char *up = b->mosaic + (size_t)mirror(y - 1, b->height) * w;
+	const unsigned char *row = b->mosaic + (size_t)y * w;
+	const unsigned char *dn = b->mosaic + (size_t)mirror(y + 1, b->height) * w;
+	unsigned char *d = dst + (size_t)y * w * 3;
+	/* colours at even and odd x of this row */
+	const int c0 = b->cfa[(y & 1) * 2], c1 = b->cfa[(y & 1) * 2 + 1];
+	int x;
+
+	pixel(b, 0, y, d);
+
+	/* interior, two pixels (one G, one R or B) per step */
+	for (x = 1; x + 2 < w; x += 2) {
+		unsigned char *o = d + 3 * x;
+		int v[3], c, ch;
+
+		/* x odd */
+		c = c1;
+		v[c] = row[x];
+		if (G == c) {
+			ch = c0;
+			v[ch] = (row[x - 1] + row[x + 1] + 1) >> 1;
+			v[R + B - ch] = (up[x] + dn[x] + 1) >> 1;
+		} else {
+			v[G] = (row[x - 1] + row[x + 1] + up[x] + dn[x] + 2) >> 2;
+			v[R + B - c] = (up[x - 1] + up[x + 1] +
+					dn[x - 1] + dn[x + 1] + 2) >> 2;
+		}
+		o[0] = v[B];
+		o[1] = v[G];
+		o[2] = v[R];
+
+		/* x + 1 even */
+		c = c0;
+		v[c] = row[x + 1];
+		if (G == c) {
+			ch = c1;
+			v[ch] = (row[x] + row[x + 2] + 1) >> 1;
+			v[R + B - ch] = (up[x + 1] + dn[x + 1] + 1) >> 1;
+		} else {
+			v[G] = (row[x] + row[x + 2] + up[x + 1] + dn[x + 1]
+				+ 2) >> 2;
+			v[R + B - c] = (up[x] + up[x + 2] +
+					dn[x] + dn[x + 2] + 2) >> 2;
+		}
+		o[3] = v[B];
+		o[4] = v[G];
+		o[5] = v[R];
+	}
+
+	for (; x < w; x++)
+		pixel(b, x, y, d + 3 * x);
+}
+
+void bayer_to_bgr24(struct bayer *b, const unsigned char *src,
+		    unsigned char *dst, unsigned int *hist)
+{
+	int y;
+
+	unpack(b, src, hist);
+
+#pragma omp parallel for schedule(static)
+	for (y = 0; y < (int)b->height; y++)
+		demosaic_row(b, y, dst);
+}
@@ -0,0 +1,44 @@
+/*
+ *  Raw Bayer to BGR24
+ *
+ *  8-, 10- and 12-bit Bayer in all four orders, 10/12-bit either in
+ *  16-bit little-endian words (SGRBG10, ...) or MIPI packed (SGRBG10P,
+ *  4 pixels in 5 bytes). Each frame is first reduced to an 8-bit mosaic
+ *  (SSE2 where available), then demosaiced bilinearly; both passes are
+ *  split across rows with OpenMP.
+ */
+
+#ifndef BAYER_H
+#define BAYER_H
+
+#include <linux/videodev2.h>
+
+struct bayer {
+	unsigned int	width, height;
+	unsigned int	bytesperline;	/* of the raw frame */
+	unsigned int	bits;		/* 8, 10, 12 */
+	int		packed;		/* MIPI CSI-2 packing */
+	unsigned char	cfa[4];		/* colour of (0,0) (1,0) (0,1) (1,1) */
+	unsigned char	*mosaic;	/* 8-bit plane, width x height */
+};
+
+/* Returns 1 if pixelformat is a Bayer format bayer_init() handles. */
+int bayer_supported(__u32 pixelformat);
+
+/* bytes of an unpadded line, 0 if pixelformat is not one of ours */
+unsigned int bayer_min_stride(__u32 pixelformat, unsigned int width);
+
+/* Returns 0, or -1 if the format is not Bayer or out of memory. */
+int bayer_init(struct bayer *b, const struct v4l2_pix_format *pix);
+
+/*
+ * src: one raw frame, dst: width * height * 3 bytes, B G R.
+ * hist, if not NULL, accumulates the 256-bin histogram of the 8-bit
+ * mosaic, i.e. of all colour sites alike.
+ */
+void bayer_to_bgr24(struct bayer *b, const unsigned char *src,
+		    unsigned char *dst, unsigned int *hist);
+
+void bayer_release(struct bayer *b);
+
+#endif /* BAYER_H */
@@ -0,0 +1,68 @@
+/*
+ *  Change detection on raw YUYV
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <string.h>
+
+#include "change_gate.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+#define STEP	4	/* sample every STEP-th pixel and line */
+
+void change_gate_init(struct change_gate *cg, unsigned int width,
+		      unsigned int height, unsigned int bytesperline,
+		      unsigned int threshold)
+{
+	unsigned int x, y;
+
+	CLEAR(*cg);
+	cg->width = width;
+	cg->height = height;
+	cg->bytesperline = bytesperline ? bytesperline : width * 2;
+	cg->threshold = threshold;
+
+	/* the grid does not change, count the samples once */
+	for (y = 0; y < height; y += STEP)
+		for (x = 0; x < width; x += STEP)
+			cg->samples[y * CHANGE_GATE_ROWS / height * CHANGE_GATE_COLS
+				    + x * CHANGE_GATE_COLS / width]++;
+}
+
+int change_gate_check(struct change_gate *cg, const unsigned char *yuyv)
+{
+	unsigned int x, y, i, d, max = 0;
+
+	memset(cg->sig, 0, sizeof(cg->sig));
+	for (y = 0; y < cg->height; y += STEP) {
+		const unsigned char *s = yuyv + (size_t)y * cg->bytesperline;
+		uint32_t *row = cg->sig +
+			y * CHANGE_GATE_ROWS / cg->height * CHANGE_GATE_COLS;
+
+		/* Y is every even byte */
+		for (x = 0; x < cg->width; x += STEP)
+			row[x * CHANGE_GATE_COLS / cg->width] += s[2 * x];
+	}
+
+	for (i = 0; i < CHANGE_GATE_CELLS; i++) {
+		if (!cg->samples[i])
+			continue;
+		cg->sig[i] /= cg->samples[i];
+		d = cg->sig[i] > cg->ref[i] ? cg->sig[i] - cg->ref[i]
+					    : cg->ref[i] - cg->sig[i];
+		if (d > max)
+			max = d;
+	}
+
+	cg->frames++;
+	cg->last_diff = max;
+	if (cg->primed && max <= cg->threshold) {
+		cg->skipped++;
+		return 0;
+	}
+	memcpy(cg->ref, cg->sig, sizeof(cg->ref));
+	cg->primed = 1;
+	return 1;
+}
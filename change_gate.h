@@ -0,0 +1,42 @@
+/*
+ *  Change detection on raw YUYV
+ *
+ *  The frame is divided into a CHANGE_GATE_COLS x CHANGE_GATE_ROWS grid
+ *  and the luma of every 4th pixel on every 4th line is summed per
+ *  cell, so the signature costs 1/16 of the frame in reads and no
+ *  conversion. A frame counts as changed if any cell mean moved by more
+ *  than the threshold since the last frame that was let through; the
+ *  reference does not follow skipped frames, so slow drifts still add
+ *  up to a change eventually.
+ */
+
+#ifndef CHANGE_GATE_H
+#define CHANGE_GATE_H
+
+#include <stdint.h>
+
+#define CHANGE_GATE_COLS	16
+#define CHANGE_GATE_ROWS	12
+#define CHANGE_GATE_CELLS	(CHANGE_GATE_COLS * CHANGE_GATE_ROWS)
+
+struct change_gate {
+	unsigned int	width, height, bytesperline;
+	unsigned int	threshold;	/* luma levels of a cell mean */
+	int		primed;		/* ref holds a frame */
+	uint32_t	ref[CHANGE_GATE_CELLS];
+	uint32_t	sig[CHANGE_GATE_CELLS];
+	uint32_t	samples[CHANGE_GATE_CELLS];	/* per cell */
+
+	unsigned long	frames;
+	unsigned long	skipped;
+	unsigned int	last_diff;	/* largest cell change, last frame */
+};
+
+void change_gate_init(struct change_gate *cg, unsigned int width,
+		      unsigned int height, unsigned int bytesperline,
+		      unsigned int threshold);
+
+/* Returns 1 if the frame changed and should be processed, 0 to skip it. */
+int change_gate_check(struct change_gate *cg, const unsigned char *yuyv);
+
+#endif /* CHANGE_GATE_H */
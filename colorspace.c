@@ -0,0 +1,198 @@
+/*
+ *  YUYV to BGR24 per Y'CbCr encoding and quantization range
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include "colorspace.h"
+
+/*
+ * For luma weights Kr, Kb (Kg = 1 - Kr - Kb) and chroma centred on 0:
+ *	R = Y + 2 (1 - Kr) Cr
+ *	B = Y + 2 (1 - Kb) Cb
+ *	G = Y - 2 Kb (1 - Kb) / Kg Cb - 2 Kr (1 - Kr) / Kg Cr
+ * Limited range: Y in 16..235 and C in 16..240 are stretched to full.
+ * The Y, R and B terms are tabled as rounded integers; the two G terms
+ * keep 8 fractional bits and are rounded once, after they are added.
+ */
+#define ROUND(x)	((int)((x) + ((x) < 0 ? -0.5 : 0.5)))
+#define FIX(x)		ROUND((x) * 256.0)
+#define YSCALE(lim)	((lim) ? 255.0 / 219.0 : 1.0)
+#define CSCALE(lim)	((lim) ? 255.0 / 224.0 : 1.0)
+#define YOFF(lim)	((lim) ? 16 : 0)
+
+#define LUT_Y(i, kr, kb, lim)	ROUND(((i) - YOFF(lim)) * YSCALE(lim))
+#define LUT_RV(i, kr, kb, lim)	ROUND(((i) - 128) * CSCALE(lim) * 2 * (1 - (kr)))
+#define LUT_BU(i, kr, kb, lim)	ROUND(((i) - 128) * CSCALE(lim) * 2 * (1 - (kb)))
+#define LUT_GU(i, kr, kb, lim)	FIX(((i) - 128) * CSCALE(lim) * 2 * (kb) * \
+				    (1 - (kb)) / (1 - (kr) - (kb)))
+#define LUT_GV(i, kr, kb, lim)	FIX(((i) - 128) * CSCALE(lim) * 2 * (kr) * \
+				    (1 - (kr)) / (1 - (kr) - (kb)))
+
+/* 256 table entries f(0) .. f(255) */
+#define R4(f, i, ...)	f((i), __VA_ARGS__), f((i) + 1, __VA_ARGS__), \
+			f((i) + 2, __VA_ARGS__), f((i) + 3, __VA_ARGS__)
+#define R16(f, i, ...)	R4(f, (i), __VA_ARGS__), R4(f, (i) + 4, __VA_ARGS__), \
+			R4(f, (i) + 8, __VA_ARGS__), R4(f, (i) + 12, __VA_ARGS__)
+#define R64(f, i, ...)	R16(f, (i), __VA_ARGS__), R16(f, (i) + 16, __VA_ARGS__), \
+			R16(f, (i) + 32, __VA_ARGS__), R16(f, (i) + 48, __VA_ARGS__)
+#define R256(f, ...)	R64(f, 0, __VA_ARGS__), R64(f, 64, __VA_ARGS__), \
+			R64(f, 128, __VA_ARGS__), R64(f, 192, __VA_ARGS__)
+
+static inline unsigned char clamp(int v)
+{
+	return v & ~255 ? (v < 0 ? 0 : 255) : v;
+}
+
+#define PIXEL(d, y, rv, guv, bu) do {		\
+	(d)[0] = clamp((y) + (bu));		\
+	(d)[1] = clamp((y) - (guv));		\
+	(d)[2] = clamp((y) + (rv));		\
+} while (0)
+
+/*
+ * Line kernels of one variant for one 4:2:2 byte order, given as the
+ * offsets of Y0, Cb, Y1 and Cr within each 4 byte pixel pair.
+ */
+#define PACKED_LINES(name, order, desc, y0, u, y1, v)			\
+static void name##_##order##_line(int pairs, const unsigned char *s,		\
+				  unsigned char *d)				\
+{										\
+	int rv, bu, guv;							\
+										\
+	while (pairs--) {							\
+		rv = name##_rv[s[v]];						\
+		bu = name##_bu[s[u]];						\
+		guv = (name##_gu[s[u]] + name##_gv[s[v]] + 128) >> 8;		\
+		PIXEL(d, name##_y[s[y0]], rv, guv, bu);				\
+		PIXEL(d + 3, name##_y[s[y1]], rv, guv, bu);			\
+		s += 4;								\
+		d += 6;								\
+	}									\
+}										\
+										\
+static void name##_##order##_line_hist(int pairs, const unsigned char *s,	\
+				       unsigned char *d, unsigned int *hist)	\
+{										\
+	int rv, bu, guv;							\
+										\
+	while (pairs--) {							\
+		rv = name##_rv[s[v]];						\
+		bu = name##_bu[s[u]];						\
+		guv = (name##_gu[s[u]] + name##_gv[s[v]] + 128) >> 8;		\
+		PIXEL(d, name##_y[s[y0]], rv, guv, bu);				\
+		PIXEL(d + 3, name##_y[s[y1]], rv, guv, bu);			\
+		hist[s[y0]]++;							\
+		hist[s[y1]]++;							\
+		s += 4;								\
+		d += 6;								\
+	}									\
+}										\
+										\
+const struct yuyv_conv order##_conv_##name = {					\
+	desc, name##_##order##_line, name##_##order##_line_hist,		\
+	name##_nv12_line							\
+}
+
+/* one variant: tables, line kernels and the descriptors */
+#define YUYV_CONV(name, desc, kr, kb, lim)					\
+static const int name##_y[256]  = { R256(LUT_Y, kr, kb, lim) };		\
+static const int name##_rv[256] = { R256(LUT_RV, kr, kb, lim) };		\
+static const int name##_bu[256] = { R256(LUT_BU, kr, kb, lim) };		\
+static const int name##_gu[256] = { R256(LUT_GU, kr, kb, lim) };		\
+static const int name##_gv[256] = { R256(LUT_GV, kr, kb, lim) };		\
+										\
+static void name##_nv12_line(int pairs, const unsigned char *y,		\
+			     const unsigned char *uv, unsigned char *d)	\
+{										\
+	int rv, bu, guv;							\
+										\
+	while (pairs--) {							\
+		rv = name##_rv[uv[1]];						\
+		bu = name##_bu[uv[0]];						\
+		guv = (name##_gu[uv[0]] + name##_gv[uv[1]] + 128) >> 8;	\
+		PIXEL(d, name##_y[y[0]], rv, guv, bu);				\
+		PIXEL(d + 3, name##_y[y[1]], rv, guv, bu);			\
+		y += 2;								\
+		uv += 2;							\
+		d += 6;								\
+	}									\
+}										\
+										\
+PACKED_LINES(name, yuyv, desc, 0, 1, 2, 3);					\
+PACKED_LINES(name, uyvy, desc, 1, 0, 3, 2);					\
+PACKED_LINES(name, yvyu, desc, 0, 3, 2, 1)
+
+YUYV_CONV(bt601_full, "BT.601 full range", 0.299, 0.114, 0);
+YUYV_CONV(bt601_lim, "BT.601 limited range", 0.299, 0.114, 1);
+YUYV_CONV(bt709_full, "BT.709 full range", 0.2126, 0.0722, 0);
+YUYV_CONV(bt709_lim, "BT.709 limited range", 0.2126, 0.0722, 1);
+
+/* full, limited, per matrix as below */
+static const struct yuyv_conv *const yuyv[] = {
+	&yuyv_conv_bt601_full, &yuyv_conv_bt601_lim,
+	&yuyv_conv_bt709_full, &yuyv_conv_bt709_lim,
+};
+static const struct yuyv_conv *const uyvy[] = {
+	&uyvy_conv_bt601_full, &uyvy_conv_bt601_lim,
+	&uyvy_conv_bt709_full, &uyvy_conv_bt709_lim,
+};
+static const struct yuyv_conv *const yvyu[] = {
+	&yvyu_conv_bt601_full, &yvyu_conv_bt601_lim,
+	&yvyu_conv_bt709_full, &yvyu_conv_bt709_lim,
+};
+
+const struct yuyv_conv *yuyv_conv_select(const struct v4l2_pix_format *pix)
+{
+	unsigned int enc = pix->ycbcr_enc;
+	unsigned int quant = pix->quantization;
+	int bt709, variant;
+
+	if (V4L2_YCBCR_ENC_DEFAULT == enc)
+		enc = V4L2_MAP_YCBCR_ENC_DEFAULT(pix->colorspace);
+	if (V4L2_QUANTIZATION_DEFAULT == quant)
+		quant = V4L2_MAP_QUANTIZATION_DEFAULT(0, pix->colorspace, enc);
+
+	switch (enc) {
+	case V4L2_YCBCR_ENC_709:
+	case V4L2_YCBCR_ENC_XV709:
+	case V4L2_YCBCR_ENC_BT2020:
+	case V4L2_YCBCR_ENC_BT2020_CONST_LUM:
+	case V4L2_YCBCR_ENC_SMPTE240M:
+		bt709 = 1;
+		break;
+	default:
+		bt709 = 0;
+		break;
+	}
+
+	if (V4L2_QUANTIZATION_FULL_RANGE == quant)
+		variant = bt709 ? 2 : 0;
+	else
+		variant = bt709 ? 3 : 1;
+
+	switch (pix->pixelformat) {
+	case V4L2_PIX_FMT_UYVY:
+		return uyvy[variant];
+	case V4L2_PIX_FMT_YVYU:
+		return yvyu[variant];
+	default:
+		return yuyv[variant];
+	}
+}
+
+void yuyv_conv_frame(const struct yuyv_conv *cv, int width, int height,
+		     const unsigned char *src, int src_stride,
+		     unsigned char *dst, unsigned int *hist)
+{
+	int l;
+
+	for (l = 0; l < height; l++) {
+		if (hist)
+			cv->line_hist(width >> 1, src, dst, hist);
+		else
+			cv->line(width >> 1, src, dst);
+		src += src_stride;
+		dst += width * 3;
+	}
+}
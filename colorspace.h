@@ -0,0 +1,63 @@
+/*
+ *  YUYV to BGR24 per Y'CbCr encoding and quantization range
+ *
+ *  One kernel is instantiated per matrix (BT.601, BT.709) and range
+ *  (full, limited), each with its own lookup tables computed by the
+ *  compiler, and for each of the 4:2:2 byte orders YUYV, UYVY and YVYU;
+ *  the variant matching the negotiated format is picked once. NV12
+ *  shares the tables. The per-line functions take no configuration, so
+ *  there is no branching on it per pixel; the histogram variant is a
+ *  separate instantiation for the same reason.
+ */
+
+#ifndef COLORSPACE_H
+#define COLORSPACE_H
+
+#include <linux/videodev2.h>
+
+/* pairs: pixel pairs of one line; s: packed 4:2:2; d: B G R */
+typedef void (*yuyv_line_fn)(int pairs, const unsigned char *s,
+			     unsigned char *d);
+typedef void (*yuyv_line_hist_fn)(int pairs, const unsigned char *s,
+				  unsigned char *d, unsigned int *hist);
+/* y: luma line; uv: the interleaved Cb Cr line shared by two luma lines */
+typedef void (*nv12_line_fn)(int pairs, const unsigned char *y,
+			     const unsigned char *uv, unsigned char *d);
+
+struct yuyv_conv {
+	const char		*name;
+	yuyv_line_fn		line;
+	yuyv_line_hist_fn	line_hist;	/* also counts luma */
+	nv12_line_fn		nv12;		/* same matrix and range */
+};
+
+extern const struct yuyv_conv yuyv_conv_bt601_full;
+extern const struct yuyv_conv yuyv_conv_bt601_lim;
+extern const struct yuyv_conv yuyv_conv_bt709_full;
+extern const struct yuyv_conv yuyv_conv_bt709_lim;
+extern const struct yuyv_conv uyvy_conv_bt601_full;
+extern const struct yuyv_conv uyvy_conv_bt601_lim;
+extern const struct yuyv_conv uyvy_conv_bt709_full;
+extern const struct yuyv_conv uyvy_conv_bt709_lim;
+extern const struct yuyv_conv yvyu_conv_bt601_full;
+extern const struct yuyv_conv yvyu_conv_bt601_lim;
+extern const struct yuyv_conv yvyu_conv_bt709_full;
+extern const struct yuyv_conv yvyu_conv_bt709_lim;
+
+/*
+ * For the byte order of pix->pixelformat (YUYV unless UYVY or YVYU),
+ * from pix->ycbcr_enc and pix->quantization, the defaults resolved
+ * through pix->colorspace as the V4L2 spec says. BT.2020 and SMPTE 240M
+ * get the BT.709 matrix, the closest one there is a kernel for.
+ */
+const struct yuyv_conv *yuyv_conv_select(const struct v4l2_pix_format *pix);
+
+/*
+ * Whole frame, source lines src_stride bytes apart (bytesperline),
+ * output lines width * 3. hist may be NULL.
+ */
+void yuyv_conv_frame(const struct yuyv_conv *cv, int width, int height,
+		     const unsigned char *src, int src_stride,
+		     unsigned char *dst, unsigned int *hist);
+
+#endif /* COLORSPACE_H */
@@ -0,0 +1,410 @@
+/*
+ *  Conversion plans
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "conv_plan.h"
+#include "topology.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+/* the registry, see conv_format_cheapest() for how cost is ranked */
+static const struct conv_format formats[] = {
+	{ V4L2_PIX_FMT_GREY,  "GREY",   8, 1, 1, CONV_GREY },
+	{ V4L2_PIX_FMT_NV12,  "NV12",  12, 2, 0, CONV_NV12 },
+	{ V4L2_PIX_FMT_YUYV,  "YUYV",  16, 2, 0, CONV_YUYV },
+	{ V4L2_PIX_FMT_UYVY,  "UYVY",  16, 2, 0, CONV_YUYV },
+	{ V4L2_PIX_FMT_YVYU,  "YVYU",  16, 2, 0, CONV_YUYV },
+	{ V4L2_PIX_FMT_BGR24, "BGR24", 24, 0, 0, CONV_BGR24 },
+	{ V4L2_PIX_FMT_RGB24, "RGB24", 24, 1, 0, CONV_RGB24 },
+};
+
+#define N_FORMATS	(sizeof(formats) / sizeof(formats[0]))
+
+const struct conv_format *conv_format_find(uint32_t fourcc)
+{
+	unsigned int i;
+
+	for (i = 0; i < N_FORMATS; i++)
+		if (formats[i].fourcc == fourcc)
+			return &formats[i];
+	return NULL;
+}
+
+unsigned int conv_format_stride(const struct conv_format *f,
+				unsigned int width)
+{
+	return width * (CONV_NV12 == f->kind ? 1 : f->bus_bits >> 3);
+}
+
+static int cheaper(const struct conv_format *a, const struct conv_format *b)
+{
+	if (a->mono != b->mono)
+		return !a->mono;
+	if (a->bus_bits != b->bus_bits)
+		return a->bus_bits < b->bus_bits;
+	return a->cpu < b->cpu;
+}
+
+uint32_t conv_format_cheapest(const uint32_t *fourcc, int n)
+{
+	const struct conv_format *f, *best = NULL;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		f = conv_format_find(fourcc[i]);
+		if (f && (!best || cheaper(f, best)))
+			best = f;
+	}
+	return best ? best->fourcc : 0;
+}
+
+static int same_format(const struct v4l2_pix_format *a,
+		       const struct v4l2_pix_format *b)
+{
+	return a->pixelformat == b->pixelformat &&
+		a->width == b->width && a->height == b->height &&
+		a->bytesperline == b->bytesperline &&
+		a->colorspace == b->colorspace &&
+		a->ycbcr_enc == b->ycbcr_enc &&
+		a->quantization == b->quantization;
+}
+
+static void release(struct conv_plan *p)
+{
+	topo_free(p->out, p->out_size);
+	tile_map_release(&p->tiles);
+	bayer_release(&p->bayer);
+	free(p->band_stats);
+	CLEAR(*p);
+}
+
+static int build(struct conv_plan *p, const struct v4l2_pix_format *pix,
+		 unsigned int flags, int node)
+{
+	int threads = 1;
+
+	CLEAR(*p);
+	p->pix = *pix;
+	p->flags = flags;
+	p->width = pix->width;
+	p->height = pix->height;
+	p->dst_stride = pix->width * 3;
+	p->out_size = (size_t)p->dst_stride * pix->height;
+
+	p->format = conv_format_find(pix->pixelformat);
+	if (p->format) {
+		p->kind = p->format->kind;
+		if (CONV_YUYV == p->kind && (flags & CONV_PLAN_TILES) &&
+		    V4L2_PIX_FMT_YUYV == pix->pixelformat)
+			p->kind = CONV_YUYV_TILES;
+		/* the driver may pad lines, never shorten them */
+		p->src_stride = conv_format_stride(p->format, pix->width);
+		if (pix->bytesperline > p->src_stride)
+			p->src_stride = pix->bytesperline;
+		p->cv = yuyv_conv_select(pix);
+		if (CONV_YUYV_TILES == p->kind &&
+		    tile_map_init(&p->tiles, p->width, p->height))
+			goto nomem;
+	} else if (bayer_supported(pix->pixelformat)) {
+		p->kind = CONV_BAYER;
+		if (bayer_init(&p->bayer, pix))
+			goto nomem;
+		p->src_stride = p->bayer.bytesperline;
+	} else {
+		fprintf(stderr, "no conversion from %.4s\n",
+			(const char *)&pix->pixelformat);
+		return -1;
+	}
+
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#endif
+	/* Bayer and tiles split their own work */
+	if (CONV_YUYV_TILES == p->kind || CONV_BAYER == p->kind)
+		threads = 1;
+	p->bands = p->height / CONV_PLAN_MIN_BAND_ROWS;
+	if (p->bands > threads)
+		p->bands = threads;
+	if (p->bands < 1)
+		p->bands = 1;
+	p->band_rows = (p->height + p->bands - 1) / p->bands;
+	/* NV12 chroma lines belong to pairs of luma lines */
+	p->band_rows = (p->band_rows + 1) & ~1u;
+	p->band_stats = calloc(p->bands, sizeof(*p->band_stats));
+
+	p->out = topo_alloc(p->out_size, node);
+	if (!p->band_stats || !p->out)
+		goto nomem;
+
+	p->valid = 1;
+	return 0;
+
+nomem:
+	fprintf(stderr, "Out of memory\n");
+	release(p);
+	return -1;
+}
+
+struct conv_plan *conv_plan_get(struct conv_plans *c,
+				const struct v4l2_pix_format *pix,
+				unsigned int flags, int node)
+{
+	struct conv_plan *p, *victim = &c->plan[0];
+	int i;
+
+	c->clock++;
+	for (i = 0; i < CONV_PLAN_CACHE; i++) {
+		p = &c->plan[i];
+		if (p->valid && p->flags == flags && same_format(&p->pix, pix)) {
+			p->used = c->clock;
+			return p;
+		}
+		if (victim->valid && (!p->valid || p->used < victim->used))
+			victim = p;
+	}
+
+	if (victim->valid)
+		release(victim);
+	if (build(victim, pix, flags, node))
+		return NULL;
+	victim->used = c->clock;
+	return victim;
+}
+
+static void grey_line(int width, const unsigned char *s, unsigned char *d,
+		      unsigned int *hist)
+{
+	int x;
+
+	for (x = 0; x < width; x++, d += 3)
+		d[0] = d[1] = d[2] = s[x];
+	if (hist)
+		for (x = 0; x < width; x++)
+			hist[s[x]]++;
+}
+
+/* BT.601 luma of a B G R or R G B pixel, for the histogram */
+#define LUMA(r, g, b)	((77 * (r) + 150 * (g) + 29 * (b) + 128) >> 8)
+
+static void rgb_line(int width, const unsigned char *s, unsigned char *d,
+		     unsigned int *hist)
+{
+	int x;
+
+	for (x = 0; x < width; x++, s += 3, d += 3) {
+		d[0] = s[2];
+		d[1] = s[1];
+		d[2] = s[0];
+	}
+	if (hist)
+		for (x = 0, d -= width * 3; x < width; x++, d += 3)
+			hist[LUMA(d[2], d[1], d[0])]++;
+}
+
+static void bgr_line(int width, const unsigned char *s, unsigned char *d,
+		     unsigned int *hist)
+{
+	int x;
+
+	if (d)
+		memcpy(d, s, width * 3);
+	if (hist)
+		for (x = 0; x < width; x++, s += 3)
+			hist[LUMA(s[2], s[1], s[0])]++;
+}
+
+/* sums and extremes of one B G R line, while it is still in the cache */
+static void line_stats(const unsigned char *d, unsigned int width,
+		       struct frame_stats *st)
+{
+	unsigned int sum[3] = { 0, 0, 0 };
+	unsigned char lo[3], hi[3];
+	unsigned int x;
+	int c;
+
+	for (c = 0; c < 3; c++)
+		lo[c] = hi[c] = d[c];
+	for (x = 0; x < width; x++, d += 3)
+		for (c = 0; c < 3; c++) {
+			sum[c] += d[c];
+			if (d[c] < lo[c])
+				lo[c] = d[c];
+			if (d[c] > hi[c])
+				hi[c] = d[c];
+		}
+	for (c = 0; c < 3; c++) {
+		st->sum[c] += sum[c];
+		if (lo[c] < st->min[c])
+			st->min[c] = lo[c];
+		if (hi[c] > st->max[c])
+			st->max[c] = hi[c];
+	}
+}
+
+static void stats_clear(struct frame_stats *st)
+{
+	CLEAR(*st);
+	memset(st->min, 255, sizeof(st->min));
+}
+
+static void stats_merge(struct frame_stats *st, const struct frame_stats *part)
+{
+	int c, i;
+
+	for (i = 0; i < 256; i++)
+		st->hist[i] += part->hist[i];
+	for (c = 0; c < 3; c++) {
+		st->sum[c] += part->sum[c];
+		if (part->min[c] < st->min[c])
+			st->min[c] = part->min[c];
+		if (part->max[c] > st->max[c])
+			st->max[c] = part->max[c];
+	}
+	st->pixels += part->pixels;
+}
+
+/*
+ * Lines y to end of the plan's kernel, with their statistics if st is
+ * not NULL. d NULL: BGR24 is not copied. convert 0: src is the finished
+ * image and only the sums and extremes are taken from it.
+ */
+static void rows(struct conv_plan *p, const unsigned char *src,
+		 unsigned char *dst, struct frame_stats *st, int convert,
+		 unsigned int y, unsigned int end)
+{
+	unsigned int src_stride = convert ? p->src_stride : p->dst_stride;
+	const unsigned char *s = src + (size_t)y * src_stride;
+	const unsigned char *uv = src + (size_t)p->src_stride * p->height;
+	unsigned char *d = dst ? dst + (size_t)y * p->dst_stride : NULL;
+	unsigned int *hist = st ? st->hist : NULL;
+	const unsigned char *out;
+	unsigned int x;
+
+	for (; y < end; y++) {
+		out = d;
+		switch (convert ? p->kind : CONV_BAYER) {
+		case CONV_YUYV:
+			if (hist)
+				p->cv->line_hist(p->width >> 1, s, d, hist);
+			else
+				p->cv->line(p->width >> 1, s, d);
+			break;
+
+		case CONV_NV12:
+			p->cv->nv12(p->width >> 1, s,
+				    uv + (size_t)(y >> 1) * p->src_stride, d);
+			if (hist)
+				for (x = 0; x < p->width; x++)
+					hist[s[x]]++;
+			break;
+
+		case CONV_GREY:
+			grey_line(p->width, s, d, hist);
+			break;
+
+		case CONV_RGB24:
+			rgb_line(p->width, s, d, hist);
+			break;
+
+		case CONV_BGR24:
+			bgr_line(p->width, s, d, hist);
+			if (!d)
+				out = s;
+			break;
+
+		default:
+			out = s;
+			break;
+		}
+		if (st)
+			line_stats(out, p->width, st);
+		s += src_stride;
+		if (d)
+			d += p->dst_stride;
+	}
+}
+
+static void bands(struct conv_plan *p, const unsigned char *src,
+		  unsigned char *dst, struct frame_stats *st, int convert)
+{
+	int b;
+
+#pragma omp parallel for num_threads(p->bands) schedule(static, 1)
+	for (b = 0; b < p->bands; b++) {
+		unsigned int y = b * p->band_rows;
+		unsigned int end = y + p->band_rows;
+		struct frame_stats *part = st ? &p->band_stats[b] : NULL;
+
+		if (end > p->height)
+			end = p->height;
+		if (part)
+			stats_clear(part);
+		if (y < end)
+			rows(p, src, dst, part, convert, y, end);
+	}
+
+	if (st)
+		for (b = 0; b < p->bands; b++)
+			stats_merge(st, &p->band_stats[b]);
+}
+
+unsigned char *conv_plan_run(struct conv_plan *p, const unsigned char *src,
+			     unsigned char *dst, struct frame_stats *st)
+{
+	if (!dst || CONV_YUYV_TILES == p->kind)
+		dst = p->out;
+	if (st)
+		stats_clear(st);
+
+	switch (p->kind) {
+	case CONV_YUYV_TILES:
+		yuyv_to_rgb24_tiles(p->width, p->height, src, p->src_stride,
+				    dst, st ? st->hist : NULL, &p->tiles, p->cv);
+		break;
+
+	case CONV_BAYER:
+		bayer_to_bgr24(&p->bayer, src, dst, st ? st->hist : NULL);
+		break;
+
+	case CONV_BGR24:
+		/* already what everyone downstream takes */
+		if (p->src_stride == p->dst_stride) {
+			dst = (unsigned char *)src;
+			if (st)
+				bands(p, src, NULL, st, 1);
+			break;
+		}
+		bands(p, src, dst, st, 1);
+		break;
+
+	default:
+		bands(p, src, dst, st, 1);
+		break;
+	}
+
+	/* these kernels keep their own split, the sums take a second look */
+	if (st && (CONV_YUYV_TILES == p->kind || CONV_BAYER == p->kind))
+		bands(p, dst, NULL, st, 0);
+	if (st)
+		st->pixels = p->width * p->height;
+	return dst;
+}
+
+void conv_plans_release(struct conv_plans *c)
+{
+	int i;
+
+	for (i = 0; i < CONV_PLAN_CACHE; i++)
+		if (c->plan[i].valid)
+			release(&c->plan[i]);
+}
@@ -0,0 +1,134 @@
+/*
+ *  Conversion plans
+ *
+ *  Every input format that can be shown or published as BGR24 has an
+ *  entry in a registry keyed by fourcc: what it costs on the bus, what
+ *  it costs to convert, and the kernel. BGR24 input needs no kernel at
+ *  all, the captured buffer is passed on as it is.
+ *
+ *  Everything the conversion of one frame needs is decided once per
+ *  negotiated format: the kernel (packed 4:2:2 or NV12 colorspace
+ *  variant, tiled YUYV, grey, RGB, Bayer), the source and output
+ *  strides, how the rows are split over the OpenMP threads, and the
+ *  output buffer, allocated on the device's NUMA node. Plans are cached
+ *  by format, so switching back to a mode that was used before costs
+ *  nothing, and per frame only conv_plan_run() is left.
+ */
+
+#ifndef CONV_PLAN_H
+#define CONV_PLAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/videodev2.h>
+
+#include "colorspace.h"
+#include "convert.h"
+#include "bayer.h"
+
+/*
+ * Collected in the same pass as the conversion, from each output line
+ * while it is still in the cache; every row band has its own partial,
+ * merged when the frame is done.
+ */
+struct frame_stats {
+	unsigned int	hist[256];	/* luma, Bayer: raw mosaic */
+	uint64_t	sum[3];		/* B G R */
+	unsigned char	min[3], max[3];
+	unsigned int	pixels;
+};
+
+#define CONV_PLAN_CACHE	4
+#define CONV_PLAN_MIN_BAND_ROWS	16
+
+/* flags */
+#define CONV_PLAN_TILES	1	/* YUYV: convert only the changed tiles */
+
+enum conv_kind {
+	CONV_YUYV,		/* and the other 4:2:2 orders */
+	CONV_YUYV_TILES,
+	CONV_NV12,
+	CONV_GREY,
+	CONV_RGB24,
+	CONV_BGR24,		/* passthrough */
+	CONV_BAYER,
+};
+
+struct conv_format {
+	uint32_t	fourcc;
+	const char	*name;
+	unsigned int	bus_bits;	/* per pixel, what the device sends */
+	unsigned int	cpu;		/* relative work to get BGR24, 0: none */
+	int		mono;		/* loses colour */
+	enum conv_kind	kind;
+};
+
+/* registry entry for fourcc, NULL if there is none (Bayer included) */
+const struct conv_format *conv_format_find(uint32_t fourcc);
+
+/* bytes of an unpadded line: of the luma plane for NV12 */
+unsigned int conv_format_stride(const struct conv_format *f,
+				unsigned int width);
+
+/*
+ * Of the n fourccs a device offers, the one that is cheapest to capture
+ * and convert: fewest bits on the bus, then least conversion work.
+ * Formats without colour are only taken if there is nothing else.
+ * Returns 0 if none of them is in the registry.
+ */
+uint32_t conv_format_cheapest(const uint32_t *fourcc, int n);
+
+struct conv_plan {
+	struct v4l2_pix_format	pix;		/* what the plan was built for */
+	unsigned int		flags;
+	enum conv_kind		kind;
+	unsigned int		width, height;
+	unsigned int		src_stride;	/* bytesperline */
+	unsigned int		dst_stride;	/* width * 3, B G R */
+	size_t			out_size;
+	unsigned char		*out;		/* persistent output image */
+
+	const struct conv_format *format;
+	const struct yuyv_conv	*cv;
+	struct tile_map		tiles;
+	struct bayer		bayer;
+
+	int			bands;		/* row bands run in parallel */
+	unsigned int		band_rows;
+	struct frame_stats	*band_stats;	/* one per band, merged per run */
+
+	int			valid;
+	unsigned long		used;		/* for replacement */
+};
+
+struct conv_plans {
+	struct conv_plan	plan[CONV_PLAN_CACHE];
+	unsigned long		clock;
+};
+
+/*
+ * The cached plan for pix and flags, or a new one replacing the least
+ * recently used. node: NUMA node for the output image, -1 for any.
+ * Returns NULL if the format cannot be converted or on allocation
+ * failure.
+ */
+struct conv_plan *conv_plan_get(struct conv_plans *c,
+				const struct v4l2_pix_format *pix,
+				unsigned int flags, int node);
+
+/*
+ * Convert one frame into dst (out_size bytes, dst_stride per line), or
+ * into plan->out if dst is NULL. The tiled kernel always writes
+ * plan->out, where the unchanged tiles are, and BGR24 input without
+ * line padding is not copied at all. st, if not NULL, is filled with
+ * the statistics of the frame (tiled and Bayer: the sums and extremes
+ * are taken in a second pass). Returns the image, which is dst only if
+ * it was written there: the caller copies otherwise, if it needs it in
+ * dst.
+ */
+unsigned char *conv_plan_run(struct conv_plan *p, const unsigned char *src,
+			     unsigned char *dst, struct frame_stats *st);
+
+void conv_plans_release(struct conv_plans *c);
+
+#endif /* CONV_PLAN_H */
@@ -0,0 +1,221 @@
+/*
+ *  Conversion benchmark
+ *
+ *  This program can be used and distributed without restrictions.
+ *
+ *  Times each capture format's path to BGR24 at one resolution:
+ *  yuyv_to_rgb24() against the Bayer unpack + demosaic, e.g.
+ *	convbench -W 1920 -H 1080
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <getopt.h>             /* getopt_long() */
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <linux/videodev2.h>
+
+#include "convert.h"
+#include "bayer.h"
+#include "colorspace.h"
+
+#define RING	4	/* source frames, cycled */
+
+static int width = 1280;
+static int height = 720;
+static int frame_count = 100;
+
+static const struct {
+	const char	*name;
+	__u32		pixelformat;
+	unsigned int	bpl_num, bpl_den;	/* bytes per pixel */
+} formats[] = {
+	{ "YUYV",     V4L2_PIX_FMT_YUYV,     2, 1 },
+	{ "SGRBG8",   V4L2_PIX_FMT_SGRBG8,   1, 1 },
+	{ "SGRBG10",  V4L2_PIX_FMT_SGRBG10,  2, 1 },
+	{ "SGRBG10P", V4L2_PIX_FMT_SGRBG10P, 5, 4 },
+	{ "SGRBG12",  V4L2_PIX_FMT_SGRBG12,  2, 1 },
+	{ "SGRBG12P", V4L2_PIX_FMT_SGRBG12P, 3, 2 },
+};
+
+#define N_FORMATS	(sizeof(formats) / sizeof(formats[0]))
+
+static const struct yuyv_conv *convs[] = {
+	&yuyv_conv_bt601_full,
+	&yuyv_conv_bt601_lim,
+	&yuyv_conv_bt709_full,
+	&yuyv_conv_bt709_lim,
+};
+
+#define N_CONVS		(sizeof(convs) / sizeof(convs[0]))
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* microseconds per frame */
+static double run(unsigned int f, unsigned char **src, unsigned char *dst)
+{
+	struct v4l2_pix_format pix;
+	struct bayer b;
+	uint64_t t;
+	int i, is_bayer = V4L2_PIX_FMT_YUYV != formats[f].pixelformat;
+
+	memset(&pix, 0, sizeof(pix));
+	pix.width = width;
+	pix.height = height;
+	pix.pixelformat = formats[f].pixelformat;
+	pix.bytesperline = width * formats[f].bpl_num / formats[f].bpl_den;
+	if (is_bayer && bayer_init(&b, &pix)) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+	t = now_us();
+	for (i = 0; i < frame_count; i++) {
+		if (is_bayer)
+			bayer_to_bgr24(&b, src[i % RING], dst, NULL);
+		else
+			yuyv_to_rgb24(width, height, src[i % RING], dst, NULL);
+	}
+	t = now_us() - t;
+
+	if (is_bayer)
+		bayer_release(&b);
+	return (double)t / frame_count;
+}
+
+static void usage(FILE *fp, int argc, char **argv)
+{
+	fprintf(fp,
+		 "Usage: %s [options]\n\n"
+		 "Options:\n"
+		 "-h | --help          Print this message\n"
+		 "-W | --width n       Frame width [%i]\n"
+		 "-H | --height n      Frame height [%i]\n"
+		 "-c | --count         Frames per format [%i]\n"
+		 "",
+		 argv[0], width, height, frame_count);
+}
+
+static const char short_options[] = "hW:H:c:";
+
+static const struct option
+long_options[] = {
+	{ "help",   no_argument,       NULL, 'h' },
+	{ "width",  required_argument, NULL, 'W' },
+	{ "height", required_argument, NULL, 'H' },
+	{ "count",  required_argument, NULL, 'c' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	unsigned char *src[RING], *dst;
+	size_t size, j;
+	unsigned int f;
+	double us, base = 0;
+	int i;
+
+	for (;;) {
+		int idx;
+		int c;
+
+		c = getopt_long(argc, argv,
+				short_options, long_options, &idx);
+
+		if (-1 == c)
+			break;
+
+		switch (c) {
+		case 0: /* getopt_long() flag */
+			break;
+
+		case 'h':
+			usage(stdout, argc, argv);
+			exit(EXIT_SUCCESS);
+
+		case 'W':
+			/* 4-pixel groups for the packed formats */
+			width = atoi(optarg) & ~3;
+			break;
+
+		case 'H':
+			height = atoi(optarg) & ~1;
+			break;
+
+		case 'c':
+			frame_count = atoi(optarg);
+			break;
+
+		default:
+			usage(stderr, argc, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (width <= 0 || height <= 0 || frame_count <= 0) {
+		usage(stderr, argc, argv);
+		exit(EXIT_FAILURE);
+	}
+
+	/* large enough for the widest source format */
+	size = (size_t)width * height * 2;
+	for (i = 0; i < RING; i++) {
+		src[i] = malloc(size);
+		if (!src[i]) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		/* something that is not constant, 10/12-bit words stay in range */
+		for (j = 0; j < size; j++)
+			src[i][j] = (j & 1) ? (j >> 8) & 3 : (j * 7 + i) & 255;
+	}
+	dst = malloc((size_t)width * height * 3);
+	if (!dst) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+
+#ifdef _OPENMP
+	printf("%dx%d, %d threads\n", width, height, omp_get_max_threads());
+#else
+	printf("%dx%d, no OpenMP\n", width, height);
+#endif
+	printf("%-10s %10s %10s %8s\n", "format", "us/frame", "Mpix/s", "vs YUYV");
+	for (f = 0; f < N_FORMATS; f++) {
+		us = run(f, src, dst);
+		if (!f)
+			base = us;
+		printf("%-10s %10.0f %10.1f %7.2fx\n", formats[f].name, us,
+		       width * height / us, us / base);
+	}
+
+	printf("\nYUYV by colorspace, against yuyv_to_rgb24()\n");
+	for (f = 0; f < N_CONVS; f++) {
+		uint64_t t = now_us();
+
+		for (i = 0; i < frame_count; i++)
+			yuyv_conv_frame(convs[f], width, height, src[i % RING],
+					width * 2, dst, NULL);
+		us = (double)(now_us() - t) / frame_count;
+		printf("%-22s %10.0f %10.1f %7.2fx\n", convs[f]->name, us,
+		       width * height / us, us / base);
+	}
+
+	for (i = 0; i < RING; i++)
+		free(src[i]);
+	free(dst);
+	return 0;
+}
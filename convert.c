@@ -0,0 +1,205 @@
+/*
+ *  Pixel format conversion
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "convert.h"
+
+/* convert from 4:2:2 YUYV interlaced to RGB24 */
+/* based on ccvt_yuyv_bgr32() from camstream */
+/* opencv/modules/highgui/src/cap_v4l.cpp */
+#define SAT(c) \
+        if (c & (~255)) { if (c < 0) c = 0; else c = 255; }
+
+/* c pixel pairs of one line */
+static inline void
+yuyv_run (int c, const unsigned char *s, unsigned char *d, unsigned int *hist)
+{
+	int r, g, b, cr, cg, cb, y1, y2;
+
+	while (c--) {
+		 y1 = *s++;
+		 cb = ((*s - 128) * 454) >> 8;
+		 cg = (*s++ - 128) * 88;
+		 y2 = *s++;
+		 cr = ((*s - 128) * 359) >> 8;
+		 cg = (cg + (*s++ - 128) * 183) >> 8;
+		 if (hist) {
+			 hist[y1]++;
+			 hist[y2]++;
+		 }
+
+		 r = y1 + cr;
+		 b = y1 + cb;
+		 g = y1 - cg;
+		 SAT(r);
+		 SAT(g);
+		 SAT(b);
+
+		*d++ = b;
+		*d++ = g;
+		*d++ = r;
+
+		 r = y2 + cr;
+		 b = y2 + cb;
+		 g = y2 - cg;
+		 SAT(r);
+		 SAT(g);
+		 SAT(b);
+
+		*d++ = b;
+		*d++ = g;
+		*d++ = r;
+	}
+}
+
+//TODO : this can't be optimized by SIMD, openMP, opencl???
+void
+yuyv_to_rgb24 (int width, int height, const unsigned char *src,
+	       unsigned char *dst, unsigned int *hist)
+{
+	int l;
+
+	l = height;
+	while (l--) {
+		yuyv_run(width >> 1, src, dst, hist);
+		src += width * 2;
+		dst += width * 3;
+	}
+}
+
+int tile_map_init(struct tile_map *tm, int width, int height)
+{
+	memset(tm, 0, sizeof(*tm));
+	tm->cols = (width + TILE_W - 1) / TILE_W;
+	tm->rows = (height + TILE_H - 1) / TILE_H;
+	tm->sig = calloc(tm->cols * tm->rows, sizeof(*tm->sig));
+	tm->dirty = calloc(TILE_MAP_BYTES(tm), 1);
+	if (!tm->sig || !tm->dirty) {
+		tile_map_release(tm);
+		return -1;
+	}
+	return 0;
+}
+
+void tile_map_release(struct tile_map *tm)
+{
+	free(tm->sig);
+	free(tm->dirty);
+	tm->sig = NULL;
+	tm->dirty = NULL;
+}
+
+/*
+ * 64-bit multiply-xorshift over the raw bytes of one tile. A collision
+ * would leave a stale tile, at about 2^-64 per changed tile.
+ */
+static uint64_t
+tile_hash (const unsigned char *s, int stride, int bytes, int lines,
+	   unsigned int *hist)
+{
+	uint64_t h = 0x9e3779b97f4a7c15ULL, w;
+	int i, l;
+
+	for (l = 0; l < lines; l++, s += stride) {
+		for (i = 0; i + 8 <= bytes; i += 8) {
+			memcpy(&w, s + i, 8);
+			h = (h ^ w) * 0xff51afd7ed558ccdULL;
+			h ^= h >> 32;
+		}
+		for (; i < bytes; i++)
+			h = (h ^ s[i]) * 0x100000001b3ULL;
+		if (hist)
+			for (i = 0; i < bytes; i += 2)
+				hist[s[i]]++;
+	}
+	return h;
+}
+
+int
+yuyv_to_rgb24_tiles (int width, int height, const unsigned char *src,
+		     int src_stride, unsigned char *dst, unsigned int *hist,
+		     struct tile_map *tm, const struct yuyv_conv *cv)
+{
+	int tx, ty, t, x0, y0, w, h, l;
+	uint64_t sig;
+
+	memset(tm->dirty, 0, TILE_MAP_BYTES(tm));
+	tm->n_dirty = 0;
+
+	for (ty = 0, t = 0; ty < tm->rows; ty++) {
+		y0 = ty * TILE_H;
+		h = height - y0 < TILE_H ? height - y0 : TILE_H;
+		for (tx = 0; tx < tm->cols; tx++, t++) {
+			const unsigned char *s;
+			unsigned char *d;
+
+			x0 = tx * TILE_W;
+			w = width - x0 < TILE_W ? width - x0 : TILE_W;
+			s = src + y0 * src_stride + x0 * 2;
+
+			sig = tile_hash(s, src_stride, w * 2, h, hist);
+			if (tm->primed && sig == tm->sig[t])
+				continue;
+			tm->sig[t] = sig;
+			tm->dirty[t >> 3] |= 1 << (t & 7);
+			tm->n_dirty++;
+
+			d = dst + (y0 * width + x0) * 3;
+			for (l = 0; l < h; l++)
+				if (cv)
+					cv->line(w >> 1, s + l * src_stride,
+						 d + l * width * 3);
+				else
+					yuyv_run(w >> 1, s + l * src_stride,
+						 d + l * width * 3, NULL);
+		}
+	}
+	tm->primed = 1;
+	return tm->n_dirty;
+}
+
+void
+yuyv_to_i420 (int width, int height, const unsigned char *src,
+	      int src_stride, int interlaced, unsigned char *y,
+	      unsigned char *u, unsigned char *v)
+{
+	int cw = (width + 1) >> 1;
+	int l;
+
+#pragma omp parallel for
+	for (l = 0; l < height; l += 2) {
+		const unsigned char *s0 = src + l * src_stride;
+		const unsigned char *c0, *c1;
+		unsigned char *y0 = y + l * width;
+		unsigned char *du = u + (l >> 1) * cw;
+		unsigned char *dv = v + (l >> 1) * cw;
+		int x, l0, l1;
+
+		for (x = 0; x < width; x++)
+			y0[x] = s0[x * 2];
+		if (l + 1 < height)
+			for (x = 0; x < width; x++)
+				y0[width + x] = s0[src_stride + x * 2];
+
+		/*
+		Chroma line l / 2 from lines l, l + 1, or within one field
+		from lines 4j + f and 4j + 2 + f for j = l / 4, f = l / 2 & 1.
+		An odd last line, or field line, is its own pair.
+		*/
+		l0 = interlaced ? (l >> 2 << 2) + (l >> 1 & 1) : l;
+		l1 = l0 + (interlaced ? 2 : 1);
+		if (l1 >= height)
+			l1 = l0;
+		c0 = src + l0 * src_stride;
+		c1 = src + l1 * src_stride;
+		for (x = 0; x < cw; x++) {
+			du[x] = (c0[x * 4 + 1] + c1[x * 4 + 1] + 1) >> 1;
+			dv[x] = (c0[x * 4 + 3] + c1[x * 4 + 3] + 1) >> 1;
+		}
+	}
+}
@@ -0,0 +1,70 @@
+/*
+ *  Pixel format conversion
+ */
+
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <stdint.h>
+
+#include "colorspace.h"
+
+/*
+ * convert from 4:2:2 YUYV interlaced to BGR24 (OpenCV channel order).
+ * hist, if not NULL, accumulates the 256-bin luma histogram on the way.
+ */
+void yuyv_to_rgb24(int width, int height, const unsigned char *src,
+		   unsigned char *dst, unsigned int *hist);
+
+/* tiles of the incremental conversion, in pixels (TILE_W even) */
+#define TILE_W	64
+#define TILE_H	16
+
+/*
+ * Which tiles of a persistent output image are up to date. dirty is a
+ * bitmap of cols * rows bits, tile t = row * cols + col at bit (t & 7)
+ * of byte t >> 3, set for the tiles the last call rewrote; consumers
+ * (display, encoder, detector) can limit their own work to those.
+ */
+struct tile_map {
+	int		cols, rows;
+	uint64_t	*sig;		/* raw content hash per tile */
+	uint8_t		*dirty;
+	int		n_dirty;
+	int		primed;		/* sig describes dst */
+};
+
+#define TILE_MAP_BYTES(tm)	(((tm)->cols * (tm)->rows + 7) / 8)
+#define TILE_DIRTY(tm, col, row) \
+	((tm)->dirty[((row) * (tm)->cols + (col)) >> 3] & \
+	 (1 << (((row) * (tm)->cols + (col)) & 7)))
+
+int tile_map_init(struct tile_map *tm, int width, int height);
+
+void tile_map_release(struct tile_map *tm);
+
+/*
+ * yuyv_to_rgb24() that only converts the tiles whose raw bytes changed
+ * since the previous call and leaves the others of dst as they are, so
+ * dst must be the same image every time. Source lines are src_stride
+ * bytes apart (bytesperline), output lines width * 3. The first call
+ * converts all. hist still covers the whole frame. cv selects the
+ * colorspace kernel, NULL for the coefficients of yuyv_to_rgb24().
+ * Returns the number of dirty tiles.
+ */
+int yuyv_to_rgb24_tiles(int width, int height, const unsigned char *src,
+			int src_stride, unsigned char *dst, unsigned int *hist,
+			struct tile_map *tm, const struct yuyv_conv *cv);
+
+/*
+ * 4:2:2 YUYV to planar 4:2:0 (I420): y is width x height, u and v are
+ * (width + 1) / 2 x (height + 1) / 2. The chroma of each pair of lines
+ * is averaged, sited as in MPEG-2; if interlaced, of each pair of lines
+ * of one field, with the chroma lines alternating between the fields
+ * (MPEG-2 interlaced siting). Source lines are src_stride bytes apart.
+ */
+void yuyv_to_i420(int width, int height, const unsigned char *src,
+		  int src_stride, int interlaced, unsigned char *y,
+		  unsigned char *u, unsigned char *v);
+
+#endif /* CONVERT_H */
@@ -0,0 +1,147 @@
+/*
+ *  V4L2 control state cache
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+
+#include "ctrl_cache.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+static int xioctl(int fh, int request, void *arg)
+{
+	int r;
+
+	do {
+		r = ioctl(fh, request, arg);
+	} while (-1 == r && EINTR == errno);
+
+	return r;
+}
+
+static struct ctrl_entry *find_entry(const struct ctrl_cache *cc, uint32_t id)
+{
+	unsigned int i;
+
+	for (i = 0; i < cc->n; i++)
+		if (cc->ent[i].id == id)
+			return (struct ctrl_entry *)&cc->ent[i];
+	return NULL;
+}
+
+void ctrl_cache_init(struct ctrl_cache *cc, int fd)
+{
+	CLEAR(*cc);
+	cc->fd = fd;
+}
+
+int ctrl_cache_subscribe(struct ctrl_cache *cc, uint32_t id)
+{
+	struct v4l2_event_subscription sub;
+	struct ctrl_entry *e;
+
+	if (find_entry(cc, id))
+		return 0;
+	if (cc->n >= CTRL_CACHE_MAX)
+		return -1;
+
+	CLEAR(sub);
+	sub.type = V4L2_EVENT_CTRL;
+	sub.id = id;
+	sub.flags = V4L2_EVENT_SUB_FL_SEND_INITIAL;
+
+	if (-1 == xioctl(cc->fd, VIDIOC_SUBSCRIBE_EVENT, &sub)) {
+		/* ENOTTY: no event support, EINVAL: no such control */
+		return -1;
+	}
+
+	e = &cc->ent[cc->n++];
+	CLEAR(*e);
+	e->id = id;
+	return 0;
+}
+
+void ctrl_cache_release(struct ctrl_cache *cc)
+{
+	struct v4l2_event_subscription sub;
+
+	if (cc->n) {
+		CLEAR(sub);
+		sub.type = V4L2_EVENT_ALL;
+		xioctl(cc->fd, VIDIOC_UNSUBSCRIBE_EVENT, &sub);
+	}
+	cc->n = 0;
+	cc->fd = -1;
+}
+
+int ctrl_cache_dequeue(struct ctrl_cache *cc)
+{
+	struct v4l2_event ev;
+	struct ctrl_entry *e;
+	int count = 0;
+
+	for (;;) {
+		CLEAR(ev);
+		/* ENOENT: no more pending events */
+		if (-1 == xioctl(cc->fd, VIDIOC_DQEVENT, &ev))
+			break;
+
+		count++;
+		cc->events++;
+		if (ev.type != V4L2_EVENT_CTRL)
+			continue;
+
+		e = find_entry(cc, ev.id);
+		if (!e)
+			continue;
+
+		if (ev.u.ctrl.changes & V4L2_EVENT_CTRL_CH_VALUE) {
+			if (e->valid && e->value != ev.u.ctrl.value)
+				e->changes++;
+			e->value = ev.u.ctrl.value;
+			e->valid = 1;
+		}
+		if (ev.u.ctrl.changes & V4L2_EVENT_CTRL_CH_RANGE) {
+			e->minimum = ev.u.ctrl.minimum;
+			e->maximum = ev.u.ctrl.maximum;
+		}
+		e->flags = ev.u.ctrl.flags;
+	}
+
+	return count;
+}
+
+int ctrl_cache_get(const struct ctrl_cache *cc, int fd, uint32_t id,
+		   int32_t *value)
+{
+	const struct ctrl_entry *e;
+
+	if (cc->fd != fd)
+		return -1;
+	e = find_entry(cc, id);
+	if (!e || !e->valid)
+		return -1;
+	*value = e->value;
+	return 0;
+}
+
+void ctrl_cache_store(struct ctrl_cache *cc, int fd, uint32_t id,
+		      int32_t value)
+{
+	struct ctrl_entry *e;
+
+	if (cc->fd != fd)
+		return;
+	e = find_entry(cc, id);
+	if (!e)
+		return;
+	if (e->valid && e->value != value)
+		e->changes++;
+	e->value = value;
+	e->valid = 1;
+}
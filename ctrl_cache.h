@@ -0,0 +1,60 @@
+/*
+ *  V4L2 control state cache
+ *
+ *  Keeps the last known value of a set of controls in memory. The values
+ *  are kept up to date by V4L2_EVENT_CTRL events, which the driver signals
+ *  on the capture fd as an exception condition (POLLPRI), so the mainloop
+ *  select() can pick them up together with the frames.
+ */
+
+#ifndef CTRL_CACHE_H
+#define CTRL_CACHE_H
+
+#include <stdint.h>
+#include <linux/videodev2.h>
+
+#define CTRL_CACHE_MAX	16
+
+struct ctrl_entry {
+	uint32_t	id;
+	int32_t		value;
+	int32_t		minimum;
+	int32_t		maximum;
+	uint32_t	flags;		/* V4L2_CTRL_FLAG_* */
+	int		valid;		/* value came from the driver */
+	unsigned int	changes;	/* number of value change events */
+};
+
+struct ctrl_cache {
+	int			fd;
+	unsigned int		n;
+	struct ctrl_entry	ent[CTRL_CACHE_MAX];
+	unsigned int		events;	/* total events dequeued */
+};
+
+/* Bind the cache to an open device. No ioctl is issued. */
+void ctrl_cache_init(struct ctrl_cache *cc, int fd);
+
+/*
+ * Subscribe to change events of a control. The driver replies with the
+ * current value (V4L2_EVENT_SUB_FL_SEND_INITIAL), so no G_CTRL is needed.
+ * Returns 0, or -1 if the driver does not support control events, in
+ * which case the caller has to keep using G_CTRL for that control.
+ */
+int ctrl_cache_subscribe(struct ctrl_cache *cc, uint32_t id);
+
+/* Unsubscribe all events and forget all values. */
+void ctrl_cache_release(struct ctrl_cache *cc);
+
+/* Drain all pending events. Returns the number of events dequeued. */
+int ctrl_cache_dequeue(struct ctrl_cache *cc);
+
+/* Returns 0 and the cached value, or -1 if the value is not cached. */
+int ctrl_cache_get(const struct ctrl_cache *cc, int fd, uint32_t id,
+		   int32_t *value);
+
+/* Record a value we wrote with S_CTRL; the driver does not echo it back. */
+void ctrl_cache_store(struct ctrl_cache *cc, int fd, uint32_t id,
+		      int32_t value);
+
+#endif /* CTRL_CACHE_H */
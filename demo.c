@@ -22,6 +22,7 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <time.h>
 
 #include <linux/videodev2.h>
 
@@ -29,6 +30,18 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "v4lcapture.h"
+#include "ctrl_cache.h"
+#include "exposure_ctl.h"
+#include "frame_pacing.h"
+#include "shm_stats.h"
+#include "frame_pub.h"
+#include "topology.h"
+#include "change_gate.h"
+#include "conv_plan.h"
+#include "latency.h"
+#include "logring.h"
+
 #define FORCED_WIDTH  640
 #define FORCED_HEIGHT 480
 #define FORCED_FORMAT V4L2_PIX_FMT_YUYV	//V4L2_PIX_FMT_MJPEG
@@ -40,33 +53,70 @@ The stable fps can only occur in the low frame rate. Higher fps>15 may not be st
 #define FORCED_FPS		(10)
 
 static int verbose = 0;
-#define pr_debug(fmt, arg...) \
-	if (verbose) fprintf(stderr, fmt, ##arg)
+/* into the log ring, -v enables the level at run time */
+#define pr_debug(fmt, arg...)	logr_debug(fmt, ##arg)
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
 
-enum io_method {
-	IO_METHOD_READ,
-	IO_METHOD_MMAP,
-	IO_METHOD_USERPTR,
-};
-
-struct buffer {
-	void   *start;
-	size_t  length;
-};
-
 static char            *dev_name;
 static enum io_method   io = IO_METHOD_MMAP;
-static int              fd = -1;
-struct buffer          *buffers;
-static unsigned int     n_buffers;
+static struct v4lcap    cap;
 static int		out_buf;
 static int              force_format;
 static int              frame_count = 0;
+static int              soft_ae;
+static uint32_t         cam_fps = FORCED_FPS;
 
 static char *windowname="v4l2 capture";
 
+/* control values kept current by V4L2_EVENT_CTRL, see extra_cam_setting() */
+static struct ctrl_cache ctrls;
+
+/* software exposure, see -a and exposure_ctl.h */
+static struct exposure_ctl aec;
+
+/* driver timestamp statistics against the negotiated frame interval */
+static struct frame_pacing pacing;
+
+/* live statistics page for statwatch, see -S */
+static int stats_on;
+static const char *stats_name;
+static struct shm_stats *stats;
+static struct shm_stats_data live;
+
+/* frame fan-out to local subscribers, see -P and framesub.c */
+static const char *pub_path;
+static int pub_raw;
+static struct frame_pub pub;
+static size_t pub_bytes;	/* filled into frame_pub_slot() this frame */
+
+/* conversion of the negotiated format, output on the device's NUMA node */
+static struct conv_plans plans;
+static struct conv_plan *plan;
+
+/* raw Bayer capture, see -g */
+static int use_bayer;
+static int support_grbg10;
+
+/* what EnumVideoFMT() found, for -b */
+static int use_cheapest;
+static uint32_t offered[32];
+static int n_offered;
+
+/* skip static frames, see -z */
+static int gate_level = -1;
+static int gate_on;
+static struct change_gate gate;
+
+/* convert only the changed tiles into plan->out, see -t */
+static int use_tiles;
+
+/* process only the newest ready frame, see -L; 'l' toggles */
+static int latest_wins;
+static unsigned long latest_skipped;
+static struct latency lat_oldest;	/* capture to displayed, per policy */
+static struct latency lat_latest;
+
 static void errno_exit(const char *s)
 {
 	fprintf(stderr, "%s error %d, %s\n", s, errno, strerror(errno));
@@ -106,6 +156,8 @@ int QueryCropCap(int fd, struct v4l2_cropcap *pcropcap)
 int GetAutoWhiteBalance(int fd)
 {
 	struct v4l2_control ctrl ={0};
+	if (!ctrl_cache_get(&ctrls, fd, V4L2_CID_AUTO_WHITE_BALANCE, &ctrl.value))
+		return ctrl.value;
 	ctrl.id = V4L2_CID_AUTO_WHITE_BALANCE;
 	if (-1 == xioctl(fd, VIDIOC_G_CTRL, &ctrl)){
 		perror("getting V4L2_CID_AUTO_WHITE_BALANCE");
@@ -121,7 +173,8 @@ int SetAutoWhiteBalance(int fd, int enable)
 	ctrl.value = enable;
 	if (-1 == xioctl(fd, VIDIOC_S_CTRL, &ctrl)){
 		perror("setting V4L2_CID_AUTO_WHITE_BALANCE");
-	}
+	}else
+		ctrl_cache_store(&ctrls, fd, ctrl.id, ctrl.value);
 //	printf("V4L2_CID_AUTO_WHITE_BALANCE = (0x%x -> 0x%x)\n",enable, GetAutoWhiteBalance(fd) );
 	return GetAutoWhiteBalance(fd) == enable;
 }
@@ -216,6 +269,7 @@ int SetAutoExposure(int fd, int type)
       perror("setting V4L2_CID_EXPOSURE_AUTO");
       return -1;
 	}
+	ctrl_cache_store(&ctrls, fd, ctrl.id, ctrl.value);
 	return type;
 }
 
@@ -223,7 +277,8 @@ int GetAutoExposure(int fd)
 {
 	struct v4l2_control ctrl ={0};
 	ctrl.id = V4L2_CID_EXPOSURE_AUTO;
-	if (-1 == xioctl(fd, VIDIOC_G_CTRL, &ctrl)){
+	if (ctrl_cache_get(&ctrls, fd, ctrl.id, &ctrl.value) &&
+	    -1 == xioctl(fd, VIDIOC_G_CTRL, &ctrl)){
 		perror("getting V4L2_CID_EXPOSURE_AUTO");
 		return -1;
 	}
@@ -241,6 +296,7 @@ int SetAutoExposureAutoPriority(int fd, int p)
       perror("setting V4L2_CID_EXPOSURE_AUTO_PRIORITY");
       return -1;
 	}
+	ctrl_cache_store(&ctrls, fd, ctrl.id, ctrl.value);
 	return p;
 }
 
@@ -248,6 +304,8 @@ int GetAutoExposureAutoPriority(int fd)
 {
 	struct v4l2_control ctrl ={0};
 	ctrl.id = V4L2_CID_EXPOSURE_AUTO_PRIORITY ;
+	if (!ctrl_cache_get(&ctrls, fd, ctrl.id, &ctrl.value))
+		return ctrl.value;
    	if (-1 == xioctl(fd,VIDIOC_G_CTRL,&ctrl)) {
       perror("getting V4L2_CID_EXPOSURE_AUTO_PRIORITY");
       return -1;
@@ -265,7 +323,11 @@ int GetAutoExposureAutoPriority(int fd)
 int SetManualExposure(int fd, int val)
 {
 	struct v4l2_control ctrl ={0};
-	if(SetAutoExposure(fd, V4L2_EXPOSURE_MANUAL) != V4L2_EXPOSURE_MANUAL){
+	int32_t mode;
+	/* skip the mode switch if the cache says we are manual already */
+	if((ctrl_cache_get(&ctrls, fd, V4L2_CID_EXPOSURE_AUTO, &mode) ||
+	    mode != V4L2_EXPOSURE_MANUAL) &&
+	   SetAutoExposure(fd, V4L2_EXPOSURE_MANUAL) != V4L2_EXPOSURE_MANUAL){
 		perror("setting V4L2_EXPOSURE_MANUAL");
 		return -1;
 	}
@@ -276,6 +338,7 @@ int SetManualExposure(int fd, int val)
       perror("setting V4L2_CID_EXPOSURE_ABSOLUTE");
       return -1;
 	}
+	ctrl_cache_store(&ctrls, fd, ctrl.id, ctrl.value);
 	return val;
 }
 
@@ -288,17 +351,59 @@ int GetManualExposure(int fd)
 	}
 */
 	ctrl.id = V4L2_CID_EXPOSURE_ABSOLUTE;
-   	if (-1 == xioctl(fd,VIDIOC_G_CTRL,&ctrl)) {
+   	if (ctrl_cache_get(&ctrls, fd, ctrl.id, &ctrl.value) &&
+	    -1 == xioctl(fd,VIDIOC_G_CTRL,&ctrl)) {
       perror("getting V4L2_EXPOSURE_MANUAL");
       return -1;
 	}
-	printf("GetManualExposure=%d\n",ctrl.value);
+	logr_info("GetManualExposure=%d\n",ctrl.value);
+	return ctrl.value;
+}
+
+/*
+	V4L2_CID_GAIN is in driver specific units, use QueryCtrlRange() for
+	its limits.
+*/
+int SetGain(int fd, int val)
+{
+	struct v4l2_control ctrl ={0};
+	ctrl.id = V4L2_CID_GAIN;
+	ctrl.value = val;
+	if (-1 == xioctl(fd,VIDIOC_S_CTRL,&ctrl)) {
+		perror("setting V4L2_CID_GAIN");
+		return -1;
+	}
+	ctrl_cache_store(&ctrls, fd, ctrl.id, ctrl.value);
+	return ctrl.value;
+}
+
+int GetGain(int fd)
+{
+	struct v4l2_control ctrl ={0};
+	ctrl.id = V4L2_CID_GAIN;
+	if (ctrl_cache_get(&ctrls, fd, ctrl.id, &ctrl.value) &&
+	    -1 == xioctl(fd,VIDIOC_G_CTRL,&ctrl)) {
+		perror("getting V4L2_CID_GAIN");
+		return -1;
+	}
 	return ctrl.value;
 }
 
+int QueryCtrlRange(int fd, uint32_t id, int *min, int *max, int *def)
+{
+	struct v4l2_queryctrl qctrl ={0};
+	qctrl.id = id;
+	if (-1 == xioctl(fd, VIDIOC_QUERYCTRL, &qctrl) ||
+	    (qctrl.flags & V4L2_CTRL_FLAG_DISABLED))
+		return -1;
+	*min = qctrl.minimum;
+	*max = qctrl.maximum;
+	*def = qctrl.default_value;
+	return 0;
+}
+
 int EnumVideoFMT(int fd)
 {
-	int support_grbg10 = 0;
 	struct v4l2_fmtdesc fmtdesc = {0};
     fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     char fourcc[5] = {0};
@@ -309,11 +414,14 @@ int EnumVideoFMT(int fd)
         strncpy(fourcc, (char *)&fmtdesc.pixelformat, 4);
         if (fmtdesc.pixelformat == V4L2_PIX_FMT_SGRBG10)
             support_grbg10 = 1;
+        if (n_offered < (int)(sizeof(offered) / sizeof(offered[0])))
+            offered[n_offered++] = fmtdesc.pixelformat;
         c = fmtdesc.flags & 1? 'C' : ' ';
         e = fmtdesc.flags & 2? 'E' : ' ';
         printf("  %s: [%c][%c], [%s]\n", fourcc, c, e, fmtdesc.description);
         fmtdesc.index++;
     }
+    return support_grbg10;
 }
 
 int GetVideoFMT(int fd, struct v4l2_format *pfmt)
@@ -412,6 +520,19 @@ void SetFPSParam(int fd, uint32_t fps)
 	}
 }
 
+int GetFrameInterval(int fd, struct v4l2_fract *ptimeperframe)
+{
+	struct v4l2_streamparm param;
+	memset(&param, 0, sizeof(param));
+	param.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (-1 == xioctl(fd, VIDIOC_G_PARM, &param)){
+		perror("getting VIDIOC_G_PARM");
+		return -1;
+	}
+	*ptimeperframe = param.parm.capture.timeperframe;
+	return 0;
+}
+
 uint32_t GetFPSParam(int fd, double fps, struct v4l2_frmivalenum *pfrmival)
 {
     struct v4l2_frmivalenum frmival[10];
@@ -432,9 +553,9 @@ uint32_t GetFPSParam(int fd, double fps, struct v4l2_frmivalenum *pfrmival)
         if (pfrmival->type == V4L2_FRMIVAL_TYPE_DISCRETE){
 	    	double f;
         	f = (double)pfrmival->discrete.denominator/pfrmival->discrete.numerator;
-        	printf("[%u/%u]\n", pfrmival->discrete.denominator, 
+        	logr_info("[%u/%u]\n", pfrmival->discrete.denominator, 
         						pfrmival->discrete.numerator);
-            printf("[%dx%d] %f fps\n", pfrmival->width, pfrmival->height,f);
+            logr_info("[%dx%d] %f fps\n", pfrmival->width, pfrmival->height,f);
             
 			fpss[pfrmival->index]=f;
 			frmival[pfrmival->index]=*pfrmival;
@@ -442,9 +563,9 @@ uint32_t GetFPSParam(int fd, double fps, struct v4l2_frmivalenum *pfrmival)
         	double f1,f2;
         	f1 = (double)pfrmival->stepwise.max.denominator/pfrmival->stepwise.max.numerator;
         	f2 = (double)pfrmival->stepwise.min.denominator/pfrmival->stepwise.min.numerator;
-            printf("[%dx%d] [%f,%f] fps\n", pfrmival->width, pfrmival->height,f1,f2);
+            logr_info("[%dx%d] [%f,%f] fps\n", pfrmival->width, pfrmival->height,f1,f2);
        	}
-       	printf("idx=%d\n", pfrmival->index);
+       	logr_info("idx=%d\n", pfrmival->index);
        	pfrmival->index++;
     }
     /* list is in increasing order */
@@ -456,7 +577,7 @@ uint32_t GetFPSParam(int fd, double fps, struct v4l2_frmivalenum *pfrmival)
     		}
     	}
     	*pfrmival = frmival[i];
-    	printf("found[%f,%f]\n", fps, fpss[i]);
+    	logr_info("found[%f,%f]\n", fps, fpss[i]);
     }
     return (uint32_t)fpss[i];
 }
@@ -545,7 +666,8 @@ int print_caps(int fd)
         cropcap.defrect.width, cropcap.defrect.height, cropcap.defrect.left, cropcap.defrect.top,
         cropcap.pixelaspect.numerator, cropcap.pixelaspect.denominator);
 	}
-    EnumVideoFMT(fd);
+    if (!use_bayer && !use_cheapest)	/* already listed by init_device() */
+        EnumVideoFMT(fd);
     //int support_grbg10 = 0;
     /*
     if (!support_grbg10)
@@ -567,18 +689,37 @@ int extra_cam_setting(int camfd)
 {
 	struct v4l2_format fmt;
 	struct v4l2_frmivalenum frmival;
+	struct v4l2_fract timeperframe;
 	uint32_t fps;
 
+	/*
+	Subscribe before anything reads a control: the initial values arrive
+	as events, so the Get*() helpers below are served from memory.
+	Drivers without event support fall back to G_CTRL.
+	*/
+	ctrl_cache_init(&ctrls, camfd);
+	ctrl_cache_subscribe(&ctrls, V4L2_CID_AUTO_WHITE_BALANCE);
+	ctrl_cache_subscribe(&ctrls, V4L2_CID_EXPOSURE_AUTO);
+	ctrl_cache_subscribe(&ctrls, V4L2_CID_EXPOSURE_AUTO_PRIORITY);
+	ctrl_cache_subscribe(&ctrls, V4L2_CID_EXPOSURE_ABSOLUTE);
+	ctrl_cache_subscribe(&ctrls, V4L2_CID_GAIN);
+	ctrl_cache_dequeue(&ctrls);
+
 	print_caps(camfd);
 	GetVideoFMT(camfd, &fmt);
-	EnumFrameRate(camfd, V4L2_PIX_FMT_YUYV);
+	EnumFrameRate(camfd, cap.fmt.fmt.pix.pixelformat);
 
 	memset(&frmival,0,sizeof(frmival));
-    frmival.pixel_format = V4L2_PIX_FMT_YUYV;
-    frmival.width = FORCED_WIDTH;
-    frmival.height = FORCED_HEIGHT;
+    frmival.pixel_format = cap.fmt.fmt.pix.pixelformat;
+    frmival.width = cap.fmt.fmt.pix.width;
+    frmival.height = cap.fmt.fmt.pix.height;
 	fps = GetFPSParam(camfd, (double)FORCED_FPS, &frmival);
 	SetFPSParam(camfd, fps);
+	if (fps)
+		cam_fps = fps;
+	/* what the driver actually agreed to, not what we asked for */
+	if (!GetFrameInterval(camfd, &timeperframe))
+		pacing_init(&pacing, &timeperframe);
 
 	GetAutoExposure(camfd);
 	SetAutoExposure(camfd, /*V4L2_EXPOSURE_MANUAL ,*/ V4L2_EXPOSURE_APERTURE_PRIORITY  );
@@ -586,7 +727,29 @@ int extra_cam_setting(int camfd)
 	printf("AutoPriority=%d\n",GetAutoExposureAutoPriority(camfd));
 //	PrintFrameInterval(camfd, frmival.pixel_format, frmival.width, frmival.height);
 //	SetAutoExposure(camfd, V4L2_EXPOSURE_MANUAL);
-	SetManualExposure(camfd, 110);
+	if (soft_ae) {
+		int emin, emax, edef, gmin, gmax, gdef;
+
+		if (QueryCtrlRange(camfd, V4L2_CID_EXPOSURE_ABSOLUTE,
+				   &emin, &emax, &edef)) {
+			fprintf(stderr, "no V4L2_CID_EXPOSURE_ABSOLUTE, "
+				"software exposure disabled\n");
+			soft_ae = 0;
+		} else {
+			if (QueryCtrlRange(camfd, V4L2_CID_GAIN,
+					   &gmin, &gmax, &gdef))
+				gmin = gmax = gdef = 0;
+			exposure_ctl_init(&aec, cam_fps, emin, emax, gmin, gmax,
+					  edef, gmin);
+			printf("exposure budget=%d (100us) at %u fps\n",
+				aec.budget, cam_fps);
+			SetManualExposure(camfd, aec.exposure);
+			if (gmax > gmin)
+				SetGain(camfd, aec.gain);
+		}
+	}
+	if (!soft_ae)
+		SetManualExposure(camfd, 110);
 	GetManualExposure(camfd);
 }
 
@@ -599,75 +762,34 @@ Step 7: Store data in OpenCV datatype
     cvShowImage("window", frame);
 */
 
-/* convert from 4:2:2 YUYV interlaced to RGB24 */
-/* based on ccvt_yuyv_bgr32() from camstream */
-/* opencv/modules/highgui/src/cap_v4l.cpp */
-#define SAT(c) \
-        if (c & (~255)) { if (c < 0) c = 0; else c = 255; }
-
-//TODO : this can't be optimized by SIMD, openMP, opencl???
-static void
-yuyv_to_rgb24 (int width, int height, unsigned char *src, unsigned char *dst)
-{
-	unsigned char *s;
-	unsigned char *d;
-	int l, c;
-	int r, g, b, cr, cg, cb, y1, y2;
-	
-	pr_debug("%s: called!, width=%d, height=%d\n", __func__, width, height);
-
-	l = height;
-	s = src;
-	d = dst;
-	while (l--) {
-		c = width >> 1;
-		while (c--) {
-			 y1 = *s++;
-			 cb = ((*s - 128) * 454) >> 8;
-			 cg = (*s++ - 128) * 88;
-			 y2 = *s++;
-			 cr = ((*s - 128) * 359) >> 8;
-			 cg = (cg + (*s++ - 128) * 183) >> 8;
-
-			 r = y1 + cr;
-			 b = y1 + cb;
-			 g = y1 - cg;
-			 SAT(r);
-			 SAT(g);
-			 SAT(b);
-
-			*d++ = b;
-			*d++ = g;
-			*d++ = r;
-
-			 r = y2 + cr;
-			 b = y2 + cb;
-			 g = y2 - cg;
-			 SAT(r);
-			 SAT(g);
-			 SAT(b);
-
-			*d++ = b;
-			*d++ = g;
-			*d++ = r;
-		}
-	}
-}
-
 /*
-p is a YUYV 422 format, so 640x480x16bits = 61440 bytes
+p is one frame in the negotiated format, see plan
 */
-static void process_image(const void *p, int size)
+static void process_image(struct v4lcap_frame *frame)
 {
+	const void *p = frame->start;
+	int size = frame->bytesused;
 	static IplImage* framecopy;
 	static uint64_t ut1;
+	unsigned char *img, *dst = NULL;
+	static struct frame_stats stats;
 	uint64_t ut2;
 	struct timeval pt2;
+	int32_t exposure = -1, gain = -1;
 	pr_debug("%s: called!, size=0x%x\n", __func__, size);
 
+	/* nothing moved: no conversion, display or publishing */
+	if (gate_on && !change_gate_check(&gate, p))
+		return;
+
 //	if (out_buf)
 //		fwrite(p, size, 1, stdout);
 
+	if (pub_path && pub_raw) {
+		memcpy(frame_pub_slot(&pub), p, size);
+		pub_bytes = size;
+	}
+
 #if 0 	//V4L2_PIX_FMT_MJPEG
     IplImage* frame;
     CvMat cvmat = cvMat(480, 640, CV_8UC3, (void*)p);//MJPEG buffer p
@@ -693,9 +815,47 @@ static void process_image(const void *p, int size)
 //		printf("size too small\n");
 //		return ;
 //	}
-	framecopy = cvCreateImage(cvSize(640,480), IPL_DEPTH_8U, 3);
-	yuyv_to_rgb24(640,480, p, framecopy->imageData);
-   	cvShowImage(windowname, framecopy);
+	/* convert straight into the shared slot and display from there */
+	if (pub_path && !pub_raw)
+		dst = frame_pub_slot(&pub);
+	/* statistics in the same pass, for the exposure loop and -v */
+	img = conv_plan_run(plan, p, dst, soft_ae || verbose ? &stats : NULL);
+	if (soft_ae || verbose) {
+		frame->stats = &stats;
+		pr_debug("BGR mean %.0f %.0f %.0f min %u %u %u max %u %u %u\n",
+			(double)stats.sum[0] / stats.pixels,
+			(double)stats.sum[1] / stats.pixels,
+			(double)stats.sum[2] / stats.pixels,
+			stats.min[0], stats.min[1], stats.min[2],
+			stats.max[0], stats.max[1], stats.max[2]);
+	}
+	if (CONV_YUYV_TILES == plan->kind)
+		pr_debug("%d/%d tiles dirty\n", plan->tiles.n_dirty,
+			plan->tiles.cols * plan->tiles.rows);
+	if (dst) {
+		/*
+		 * the slots rotate, only plan->out keeps the unchanged tiles,
+		 * and BGR24 is shown straight from the capture buffer
+		 */
+		if (img != dst)
+			memcpy(dst, img, plan->out_size);
+		pub_bytes = plan->out_size;
+	}
+	if (!framecopy)
+		framecopy = cvCreateImageHeader(cvSize(plan->width, plan->height), IPL_DEPTH_8U, 3);
+	cvSetData(framecopy, img, plan->dst_stride);
+	if (soft_ae) {
+		int e, g;
+		if (exposure_ctl_update(&aec, stats.hist, &e, &g)) {
+			pr_debug("ae: mean=%.0f exposure=%d gain=%d\n",
+				aec.mean, e, g);
+			SetManualExposure(cap.fd, e);
+			if (aec.gain_max > aec.gain_min)
+				SetGain(cap.fd, g);
+		}
+	}
+	if (CONV_YUYV_TILES != plan->kind || plan->tiles.n_dirty)
+		cvShowImage(windowname, framecopy);
 //    cvCvtColor(frame, );
 //    CvMat cvmat = cvMat(480, 640,  CV_8UC2, (void*)p);//V4L2_PIX_FMT_YUYV, 16bits
 #endif
@@ -703,7 +863,10 @@ static void process_image(const void *p, int size)
 	ut2 = (pt2.tv_sec * 1000000) + pt2.tv_usec;
 	if( ut1 && (ut2 > ut1)){
 //			printf("\npt=%lu us, fps=%.1f\n", ut2-ut1, 1000000.0/(ut2-ut1));
-		pr_debug("fps=%.0f\n", 1000000.0/(ut2-ut1));
+		ctrl_cache_get(&ctrls, cap.fd, V4L2_CID_EXPOSURE_ABSOLUTE, &exposure);
+		ctrl_cache_get(&ctrls, cap.fd, V4L2_CID_GAIN, &gain);
+		pr_debug("fps=%.0f exposure=%d gain=%d\n", 1000000.0/(ut2-ut1),
+			exposure, gain);
 	}
 	ut1=ut2;
 
@@ -712,96 +875,95 @@ static void process_image(const void *p, int size)
 //	fflush(stdout);
 }
 
-static int read_frame(void)
+static uint64_t now_us(void)
 {
-	struct v4l2_buffer buf;
-	unsigned int i;
-
-	pr_debug("%s: called!\n", __func__);
-
-	switch (io) {
-	case IO_METHOD_READ:
-		if (-1 == read(fd, buffers[0].start, buffers[0].length)) {
-			switch (errno) {
-			case EAGAIN:
-				return 0;
+	struct timespec ts;
 
-			case EIO:
-				/* Could ignore EIO, see spec. */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-				/* fall through */
+/* t_dq: when VIDIOC_DQBUF returned; called after process_image() */
+static void publish_stats(const struct v4l2_buffer *buf, uint64_t t_dq)
+{
+	uint64_t ts = (uint64_t)buf->timestamp.tv_sec * 1000000
+		+ buf->timestamp.tv_usec;
+
+	if (!stats)
+		return;
+	live.frames = pacing.frames;
+	live.drops = pacing.lost;
+	live.timestamp = ts;
+	live.fps = pacing.avg > 0 ? 1000000.0 / pacing.avg : 0;
+	live.jitter = pacing_jitter(&pacing);
+	/* only comparable if the driver stamps with CLOCK_MONOTONIC */
+	if ((buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+	    V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC && t_dq > ts)
+		live.dqbuf_us = t_dq - ts;
+	live.process_us = now_us() - t_dq;
+	live.queued = cap.queued;
+	live.skipped = gate.skipped;
+	live.n_buffers = cap.n_buffers;
+	/* ctrl_cache_get() leaves these alone when the control is unknown */
+	live.exposure = live.gain = -1;
+	ctrl_cache_get(&ctrls, cap.fd, V4L2_CID_EXPOSURE_ABSOLUTE, &live.exposure);
+	ctrl_cache_get(&ctrls, cap.fd, V4L2_CID_GAIN, &live.gain);
+	shm_stats_publish(stats, &live);
+}
 
-			default:
-				errno_exit("read");
-			}
-		}
+/* hand what process_image() left in the slot to the subscribers */
+static void publish_frame(const struct v4l2_buffer *buf)
+{
+	if (!pub_bytes)
+		return;
+	frame_pub_commit(&pub, pub_bytes, buf->sequence,
+		(uint64_t)buf->timestamp.tv_sec * 1000000 + buf->timestamp.tv_usec);
+	pub_bytes = 0;
+}
 
-		process_image(buffers[0].start, buffers[0].length);
+static void pace_frame(const struct v4l2_buffer *buf)
+{
+	switch (pacing_update(&pacing, buf)) {
+	case 1:
+		fprintf(stderr, "frame rate changed: %.2f fps, negotiated %.2f fps"
+			" (exposure auto priority?)\n",
+			1000000.0 / pacing.avg, 1000000.0 / pacing.nominal);
 		break;
-
-	case IO_METHOD_MMAP:
-		CLEAR(buf);
-
-		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.memory = V4L2_MEMORY_MMAP;
-
-		if (-1 == xioctl(fd, VIDIOC_DQBUF, &buf)) {
-			switch (errno) {
-			case EAGAIN:
-				return 0;
-
-			case EIO:
-				/* Could ignore EIO, see spec. */
-
-				/* fall through */
-
-			default:
-				errno_exit("VIDIOC_DQBUF");
-			}
-		}
-
-		assert(buf.index < n_buffers);
-
-		process_image(buffers[buf.index].start, buf.bytesused);
-
-		if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-			errno_exit("VIDIOC_QBUF");
+	case -1:
+		fprintf(stderr, "frame rate back to %.2f fps\n",
+			1000000.0 / pacing.avg);
 		break;
+	}
+}
 
-	case IO_METHOD_USERPTR:
-		CLEAR(buf);
-
-		buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.memory = V4L2_MEMORY_USERPTR;
-
-		if (-1 == xioctl(fd, VIDIOC_DQBUF, &buf)) {
-			switch (errno) {
-			case EAGAIN:
-				return 0;
-
-			case EIO:
-				/* Could ignore EIO, see spec. */
-
-				/* fall through */
-
-			default:
-				errno_exit("VIDIOC_DQBUF");
-			}
-		}
-
-		for (i = 0; i < n_buffers; ++i)
-			if (buf.m.userptr == (unsigned long)buffers[i].start
-			    && buf.length == buffers[i].length)
-				break;
-
-		assert(i < n_buffers);
+static int read_frame(void)
+{
+	struct v4lcap_frame frame;
+	uint64_t t_dq;
+	int r;
 
-		process_image((void *)buf.m.userptr, buf.bytesused);
+	pr_debug("%s: called!\n", __func__);
 
-		if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-			errno_exit("VIDIOC_QBUF");
-		break;
-	}
+	if (latest_wins)
+		r = v4lcap_dequeue_latest(&cap, &frame, &latest_skipped);
+	else
+		r = v4lcap_dequeue(&cap, &frame);
+	if (-1 == r)
+		exit(EXIT_FAILURE);
+	if (0 == r)
+		return 0;
+	t_dq = now_us();
+
+	/* the frames skipped for the newest would read as lost */
+	if (IO_METHOD_READ != cap.io && !latest_wins)
+		pace_frame(&frame.buf);
+	process_image(&frame);
+	latency_add_since(latest_wins ? &lat_latest : &lat_oldest, &frame.buf);
+	publish_frame(&frame.buf);
+	publish_stats(&frame.buf, t_dq);
+
+	if (-1 == v4lcap_requeue(&cap, &frame))
+		exit(EXIT_FAILURE);
 
 	return 1;
 }
@@ -815,18 +977,26 @@ static void mainloop(void)
 	count = frame_count?frame_count:0xffffffff;
 	while (count-- > 0) {
 		for (;;) {
-			fd_set fds;
+			fd_set fds, efds;
 			struct timeval tv;
-			int r;
+			int r, nfds = cap.fd;
 
 			FD_ZERO(&fds);
-			FD_SET(fd, &fds);
+			FD_SET(cap.fd, &fds);
+			if (pub_path) {
+				FD_SET(pub.listen_fd, &fds);
+				if (pub.listen_fd > nfds)
+					nfds = pub.listen_fd;
+			}
+			/* control events are signalled as an exception */
+			FD_ZERO(&efds);
+			FD_SET(cap.fd, &efds);
 
 			/* Timeout. */
 			tv.tv_sec = 2;
 			tv.tv_usec = 0;
 
-			r = select(fd + 1, &fds, NULL, NULL, &tv);
+			r = select(nfds + 1, &fds, NULL, &efds, &tv);
 
 			if (-1 == r) {
 				if (EINTR == errno)
@@ -839,8 +1009,19 @@ static void mainloop(void)
 				exit(EXIT_FAILURE);
 			}
 
+			if (FD_ISSET(cap.fd, &efds))
+				ctrl_cache_dequeue(&ctrls);
+
+			if (pub_path && FD_ISSET(pub.listen_fd, &fds))
+				frame_pub_accept(&pub);
+
 			if( (ch=cvWaitKey(1)) =='q') //this waitkey pause can make CV display visible
 				goto exit;
+			if (ch == 'l') {
+				latest_wins = !latest_wins;
+				fprintf(stderr, "\n%s\n", latest_wins ?
+					"newest frame only" : "every frame in order");
+			}
 
 			if (read_frame())
 				break;
@@ -852,464 +1033,113 @@ exit:;
 
 static void stop_capturing(void)
 {
-	enum v4l2_buf_type type;
-
 	pr_debug("%s: called!\n", __func__);
 
-	switch (io) {
-	case IO_METHOD_READ:
-		/* Nothing to do. */
-		break;
-
-	case IO_METHOD_MMAP:
-	case IO_METHOD_USERPTR:
-		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		if (-1 == xioctl(fd, VIDIOC_STREAMOFF, &type))
-			errno_exit("VIDIOC_STREAMOFF");
-		break;
-	}
+	if (v4lcap_stop(&cap))
+		exit(EXIT_FAILURE);
 }
 
 static void start_capturing(void)
-{
-	unsigned int i;
-	enum v4l2_buf_type type;
-	int err;
-
-	pr_debug("%s: called!\n", __func__);
-
-	pr_debug("\tn_buffers: %d\n", n_buffers);
-
-	switch (io) {
-	case IO_METHOD_READ:
-		/* Nothing to do. */
-		break;
-
-	case IO_METHOD_MMAP:
-		for (i = 0; i < n_buffers; ++i) {
-			struct v4l2_buffer buf;
-
-			pr_debug("\ti: %d\n", i);
-
-			CLEAR(buf);
-			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			buf.memory = V4L2_MEMORY_MMAP;
-			buf.index = i;
-
-			pr_debug("\tbuf.index: %d\n", buf.index);
-
-			err == xioctl(fd, VIDIOC_QBUF, &buf);
-			pr_debug("\terr: %d\n", err);
-
-			if (-1 == err)
-				errno_exit("VIDIOC_QBUF");
-
-			pr_debug("\tbuffer queued!\n");
-		}
-
-		pr_debug("Before STREAMON\n");
-		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		if (-1 == xioctl(fd, VIDIOC_STREAMON, &type))
-			errno_exit("VIDIOC_STREAMON");
-		pr_debug("After STREAMON\n");
-		break;
-
-	case IO_METHOD_USERPTR:
-		for (i = 0; i < n_buffers; ++i) {
-			struct v4l2_buffer buf;
-
-			CLEAR(buf);
-			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			buf.memory = V4L2_MEMORY_USERPTR;
-			buf.index = i;
-			buf.m.userptr = (unsigned long)buffers[i].start;
-			buf.length = buffers[i].length;
-
-			if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-				errno_exit("VIDIOC_QBUF");
-		}
-		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		if (-1 == xioctl(fd, VIDIOC_STREAMON, &type))
-			errno_exit("VIDIOC_STREAMON");
-		break;
-	}
-}
-
-static void uninit_device(void)
-{
-	unsigned int i;
-
-	pr_debug("%s: called!\n", __func__);
-
-	switch (io) {
-	case IO_METHOD_READ:
-		free(buffers[0].start);
-		break;
-
-	case IO_METHOD_MMAP:
-		for (i = 0; i < n_buffers; ++i)
-			if (-1 == munmap(buffers[i].start, buffers[i].length))
-				errno_exit("munmap");
-		break;
-
-	case IO_METHOD_USERPTR:
-		for (i = 0; i < n_buffers; ++i)
-			free(buffers[i].start);
-		break;
-	}
-
-	free(buffers);
-}
-
-static void init_read(unsigned int buffer_size)
 {
 	pr_debug("%s: called!\n", __func__);
 
-	buffers = calloc(1, sizeof(*buffers));
-
-	if (!buffers) {
-		fprintf(stderr, "Out of memory\n");
+	if (v4lcap_start(&cap))
 		exit(EXIT_FAILURE);
-	}
-
-	buffers[0].length = buffer_size;
-	buffers[0].start = malloc(buffer_size);
-
-	if (!buffers[0].start) {
-		fprintf(stderr, "Out of memory\n");
-		exit(EXIT_FAILURE);
-	}
 }
 
-static void init_mmap(void)
+static void init_device(void)
 {
-	struct v4l2_requestbuffers req;
+	struct v4l2_pix_format forced;
 
 	pr_debug("%s: called!\n", __func__);
 
-	CLEAR(req);
-
-	req.count = 4;
-	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	req.memory = V4L2_MEMORY_MMAP;
-
-	if (-1 == xioctl(fd, VIDIOC_REQBUFS, &req)) {
-		if (EINVAL == errno) {
-			fprintf(stderr, "%s does not support "
-				 "memory mapping\n", dev_name);
-			exit(EXIT_FAILURE);
+	CLEAR(forced);
+	forced.width       = FORCED_WIDTH;
+	forced.height      = FORCED_HEIGHT;
+	forced.pixelformat = FORCED_FORMAT;
+	forced.field       = FORCED_FIELD;
+
+	if (use_cheapest) {
+		EnumVideoFMT(cap.fd);
+		forced.pixelformat = conv_format_cheapest(offered, n_offered);
+		if (forced.pixelformat) {
+			pr_debug("cheapest format: %s\n",
+				conv_format_find(forced.pixelformat)->name);
+			force_format++;
 		} else {
-			errno_exit("VIDIOC_REQBUFS");
+			fprintf(stderr, "%s offers nothing that converts to BGR24\n",
+				dev_name);
+			forced.pixelformat = FORCED_FORMAT;
 		}
+	} else if (use_bayer) {
+		if (EnumVideoFMT(cap.fd)) {
+			forced.pixelformat = V4L2_PIX_FMT_SGRBG10;
+			force_format++;
+		} else
+			fprintf(stderr, "%s doesn't support GRBG10\n", dev_name);
 	}
-	pr_debug("\treq.count: %d\n", req.count);
-	pr_debug("\treq.type: %d\n", req.type);
-	pr_debug("\treq.memory: %d\n", req.memory);
-	pr_debug("\n");
-
-
-	if (req.count < 2) {
-		fprintf(stderr, "Insufficient buffer memory on %s\n",
-			 dev_name);
-		exit(EXIT_FAILURE);
-	}
-
-	buffers = calloc(req.count, sizeof(*buffers));
 
-	if (!buffers) {
-		fprintf(stderr, "Out of memory\n");
+	if (v4lcap_set_format(&cap, force_format ? &forced : NULL))
 		exit(EXIT_FAILURE);
-	}
 
-	for (n_buffers = 0; n_buffers < req.count; ++n_buffers) {
-		struct v4l2_buffer buf;
-
-		CLEAR(buf);
-
-		buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		buf.memory      = V4L2_MEMORY_MMAP;
-		buf.index       = n_buffers;
-
-		if (-1 == xioctl(fd, VIDIOC_QUERYBUF, &buf))
-			errno_exit("VIDIOC_QUERYBUF");
-
-		pr_debug("\tbuf.index: %d\n", buf.index);
-		pr_debug("\tbuf.type: %d\n", buf.type);
-		pr_debug("\tbuf.bytesused: %d\n", buf.bytesused);
-		pr_debug("\tbuf.flags: %d\n", buf.flags);
-		pr_debug("\tbuf.field: %d\n", buf.field);
-		pr_debug("\tbuf.timestamp.tv_sec: %ld\n", (long) buf.timestamp.tv_sec);
-		pr_debug("\tbuf.timestamp.tv_usec: %ld\n", (long) buf.timestamp.tv_usec);
-		pr_debug("\tbuf.timecode.type: %d\n", buf.timecode.type);
-		pr_debug("\tbuf.timecode.flags: %d\n", buf.timecode.flags);
-		pr_debug("\tbuf.timecode.frames: %d\n", buf.timecode.frames);
-		pr_debug("\tbuf.timecode.seconds: %d\n", buf.timecode.seconds);
-		pr_debug("\tbuf.timecode.minutes: %d\n", buf.timecode.minutes);
-		pr_debug("\tbuf.timecode.hours: %d\n", buf.timecode.hours);
-		pr_debug("\tbuf.timecode.userbits: %d,%d,%d,%d\n",
-				buf.timecode.userbits[0],
-				buf.timecode.userbits[1],
-				buf.timecode.userbits[2],
-				buf.timecode.userbits[3]);
-		pr_debug("\tbuf.sequence: %d\n", buf.sequence);
-		pr_debug("\tbuf.memory: %d\n", buf.memory);
-		pr_debug("\tbuf.m.offset: %d\n", buf.m.offset);
-		pr_debug("\tbuf.length: %d\n", buf.length);
-		pr_debug("\tbuf.input: %d\n", buf.input);
-		pr_debug("\n");
-
-		buffers[n_buffers].length = buf.length;
-		buffers[n_buffers].start =
-			mmap(NULL /* start anywhere */,
-			      buf.length,
-			      PROT_READ | PROT_WRITE /* required */,
-			      MAP_SHARED /* recommended */,
-			      fd, buf.m.offset);
-
-		if (MAP_FAILED == buffers[n_buffers].start)
-			errno_exit("mmap");
+	if (gate_level >= 0) {
+		if (V4L2_PIX_FMT_YUYV == cap.fmt.fmt.pix.pixelformat) {
+			change_gate_init(&gate, cap.fmt.fmt.pix.width,
+				cap.fmt.fmt.pix.height, cap.fmt.fmt.pix.bytesperline,
+				gate_level);
+			gate_on = 1;
+		} else
+			fprintf(stderr, "change gate needs YUYV, disabled\n");
 	}
-}
 
-static void init_userp(unsigned int buffer_size)
-{
-	struct v4l2_requestbuffers req;
-
-	pr_debug("%s: called!\n", __func__);
-
-	CLEAR(req);
-
-	req.count  = 4;
-	req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	req.memory = V4L2_MEMORY_USERPTR;
-
-	if (-1 == xioctl(fd, VIDIOC_REQBUFS, &req)) {
-		if (EINVAL == errno) {
-			fprintf(stderr, "%s does not support "
-				 "user pointer i/o\n", dev_name);
-			exit(EXIT_FAILURE);
-		} else {
-			errno_exit("VIDIOC_REQBUFS");
-		}
+	if (use_tiles && V4L2_PIX_FMT_YUYV != cap.fmt.fmt.pix.pixelformat) {
+		fprintf(stderr, "tiled conversion needs YUYV, disabled\n");
+		use_tiles = 0;
 	}
 
-	buffers = calloc(4, sizeof(*buffers));
-
-	if (!buffers) {
-		fprintf(stderr, "Out of memory\n");
+	/* whatever size, stride and Bayer order the driver settled on */
+	plan = conv_plan_get(&plans, &cap.fmt.fmt.pix,
+		use_tiles ? CONV_PLAN_TILES : 0, cap.node);
+	if (!plan)
 		exit(EXIT_FAILURE);
-	}
+	if (plan->cv)
+		pr_debug("YUYV conversion: %s\n", plan->cv->name);
+	pr_debug("%ux%u stride %u, %d bands\n", plan->width, plan->height,
+		plan->src_stride, plan->bands);
 
-	for (n_buffers = 0; n_buffers < 4; ++n_buffers) {
-		buffers[n_buffers].length = buffer_size;
-		buffers[n_buffers].start = malloc(buffer_size);
+	extra_cam_setting(cap.fd);
 
-		if (!buffers[n_buffers].start) {
-			fprintf(stderr, "Out of memory\n");
-			exit(EXIT_FAILURE);
-		}
-	}
-}
-
-static void init_device(void)
-{
-	struct v4l2_capability cap;
-	struct v4l2_cropcap cropcap;
-	struct v4l2_crop crop;
-	struct v4l2_format fmt;
-	unsigned int min;
-
-	pr_debug("%s: called!\n", __func__);
-
-	if (-1 == xioctl(fd, VIDIOC_QUERYCAP, &cap)) {
-		if (EINVAL == errno) {
-			fprintf(stderr, "%s is no V4L2 device\n",
-				 dev_name);
-			exit(EXIT_FAILURE);
-		} else {
-			errno_exit("VIDIOC_QUERYCAP");
-		}
-	}
-
-	pr_debug("\tdriver: %s\n"
-		 "\tcard: %s \n"
-		 "\tbus_info: %s\n",
-			cap.driver, cap.card, cap.bus_info);
-	pr_debug("\tversion: %u.%u.%u\n",
-			(cap.version >> 16) & 0xFF,
-			(cap.version >> 8) & 0xFF,
-			cap.version & 0xFF);
-	pr_debug("\tcapabilities: 0x%08x\n", cap.capabilities);
-
-	if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
-		fprintf(stderr, "%s is no video capture device\n",
-			 dev_name);
+	if (v4lcap_init_buffers(&cap))
 		exit(EXIT_FAILURE);
-	}
-
-	switch (io) {
-	case IO_METHOD_READ:
-		if (!(cap.capabilities & V4L2_CAP_READWRITE)) {
-			fprintf(stderr, "%s does not support read i/o\n",
-				 dev_name);
-			exit(EXIT_FAILURE);
-		}
-		break;
-
-	case IO_METHOD_MMAP:
-	case IO_METHOD_USERPTR:
-		if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
-			fprintf(stderr, "%s does not support streaming i/o\n",
-				 dev_name);
-			exit(EXIT_FAILURE);
-		}
-		break;
-	}
-
-
-	/* Select video input, video standard and tune here. */
-
-
-	CLEAR(cropcap);
-
-	cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-
-	if (0 == xioctl(fd, VIDIOC_CROPCAP, &cropcap)) {
-		pr_debug("\tcropcap.type: %d\n", cropcap.type);
-		pr_debug("\tcropcap.bounds.left: %d\n", cropcap.bounds.left);
-		pr_debug("\tcropcap.bounds.top: %d\n", cropcap.bounds.top);
-		pr_debug("\tcropcap.bounds.width: %d\n", cropcap.bounds.width);
-		pr_debug("\tcropcap.bounds.height: %d\n", cropcap.bounds.height);
-
-		pr_debug("\tcropcap.defrect.left: %d\n", cropcap.defrect.left);
-		pr_debug("\tcropcap.defrect.top: %d\n", cropcap.defrect.top);
-		pr_debug("\tcropcap.defrect.width: %d\n", cropcap.defrect.width);
-		pr_debug("\tcropcap.defrect.height: %d\n", cropcap.defrect.height);
-
-		pr_debug("\tcropcap.pixelaspect.numerator: %d\n", cropcap.pixelaspect.numerator);
-		pr_debug("\tcropcap.pixelaspect.denominator: %d\n", cropcap.pixelaspect.denominator);
-		pr_debug("\n");
-
-		CLEAR(crop);
-		crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		crop.c = cropcap.defrect; /* reset to default */
-
-		if (-1 == xioctl(fd, VIDIOC_S_CROP, &crop)) {
-			switch (errno) {
-			case EINVAL:
-				/* Cropping not supported. */
-				break;
-			default:
-				/* Errors ignored. */
-				pr_debug("\tcropping not supported\n");
-				break;
-			}
-		}
-	} else {
-		/* Errors ignored. */
-	}
-
-
-	CLEAR(fmt);
-
-	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	if (force_format) {
-		fmt.fmt.pix.width       = FORCED_WIDTH;
-		fmt.fmt.pix.height      = FORCED_HEIGHT;
-		fmt.fmt.pix.pixelformat = FORCED_FORMAT;
-		fmt.fmt.pix.field       = FORCED_FIELD;
-
-		pr_debug("\tfmt.fmt.pix.pixelformat: %c,%c,%c,%c\n",
-				fmt.fmt.pix.pixelformat & 0xFF,
-				(fmt.fmt.pix.pixelformat >> 8) & 0xFF,
-				(fmt.fmt.pix.pixelformat >> 16) & 0xFF,
-				(fmt.fmt.pix.pixelformat >> 24) & 0xFF
-				);
-		pr_debug("\n");
-		/*
-		This, VIDIOC_S_FMT, is one time setting, so you can NOT set twice.
-		You can't change the format while buffers are allocated. 
-		You need to free the buffers before, using VIDIOC_REQBUFS with a buffer
-		count of 0.
-		*/
-		if (-1 == xioctl(fd, VIDIOC_S_FMT, &fmt))
-			errno_exit("VIDIOC_S_FMT");
-
-		/* Note VIDIOC_S_FMT may change width and height. */
-	} else {
-		/* Preserve original settings as set by v4l2-ctl for example */
-		if (-1 == xioctl(fd, VIDIOC_G_FMT, &fmt))
-			errno_exit("VIDIOC_G_FMT");
-
-		fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		pr_debug("\tfmt.fmt.pix.pixelformat: %c,%c,%c,%c\n",
-				fmt.fmt.pix.pixelformat & 0xFF,
-				(fmt.fmt.pix.pixelformat >> 8) & 0xFF,
-				(fmt.fmt.pix.pixelformat >> 16) & 0xFF,
-				(fmt.fmt.pix.pixelformat >> 24) & 0xFF
-				);
-
-	}
-
-	/* Buggy driver paranoia. */
-	min = fmt.fmt.pix.width * 2;
-	if (fmt.fmt.pix.bytesperline < min)
-		fmt.fmt.pix.bytesperline = min;
-	min = fmt.fmt.pix.bytesperline * fmt.fmt.pix.height;
-	if (fmt.fmt.pix.sizeimage < min)
-		fmt.fmt.pix.sizeimage = min;
-
-	extra_cam_setting(fd);
-
-	switch (io) {
-	case IO_METHOD_READ:
-		init_read(fmt.fmt.pix.sizeimage);
-		break;
-
-	case IO_METHOD_MMAP:
-		init_mmap();
-		break;
-
-	case IO_METHOD_USERPTR:
-		init_userp(fmt.fmt.pix.sizeimage);
-		break;
-	}
 }
 
 static void close_device(void)
 {
 	pr_debug("%s: called!\n", __func__);
 
-	if (-1 == close(fd))
-		errno_exit("close");
+	ctrl_cache_release(&ctrls);
+
+	conv_plans_release(&plans);
+	plan = NULL;
 
-	fd = -1;
+	if (v4lcap_close(&cap))
+		exit(EXIT_FAILURE);
 }
 
 static void open_device(void)
 {
-	struct stat st;
-
 	pr_debug("%s: called!\n", __func__);
 
-	if (-1 == stat(dev_name, &st)) {
-		fprintf(stderr, "Cannot identify '%s': %d, %s\n",
-			 dev_name, errno, strerror(errno));
+	cap.verbose = verbose;
+	if (v4lcap_open(&cap, dev_name, io))
 		exit(EXIT_FAILURE);
-	}
 
-	if (!S_ISCHR(st.st_mode)) {
-		fprintf(stderr, "%s is no device\n", dev_name);
+	/*
+	Keep this thread, and the workers it starts, next to the device
+	before any buffer is allocated and touched.
+	*/
+	if (cap.node >= 0 && topo_bind_node(cap.node))
 		exit(EXIT_FAILURE);
-	}
-
-	fd = open(dev_name, O_RDWR /* required */ | O_NONBLOCK, 0);
-
-	if (-1 == fd) {
-		fprintf(stderr, "Cannot open '%s': %d, %s\n",
-			 dev_name, errno, strerror(errno));
-		exit(EXIT_FAILURE);
-	}
 }
 
 static void usage(FILE *fp, int argc, char **argv)
@@ -1327,11 +1157,23 @@ static void usage(FILE *fp, int argc, char **argv)
 		 "-f | --format        Force format to 640x480 YUYV\n"
 		 "-c | --count         Number of frames to grab [%i]\n"
 		 "-v | --verbose       Verbose output\n"
+		 "-a | --ae            Software exposure within the frame interval\n"
+		 "-S | --stats         Publish live statistics in /dev/shm\n"
+		 "-P | --publish sock  Share BGR24 frames with local subscribers\n"
+		 "-w | --raw           Share the raw frames instead (with -P)\n"
+		 "-g | --bayer         Capture raw GRBG10 and demosaic\n"
+		 "-z | --gate level    Skip frames whose luma changed by at most\n"
+		 "                     level (0-255) anywhere on a coarse grid\n"
+		 "-t | --tiles         Only convert the 64x16 tiles that changed\n"
+		 "-b | --cheapest      Capture the format that is cheapest to\n"
+		 "                     transfer and convert (640x480)\n"
+		 "-L | --latest        Only process the newest ready frame when\n"
+		 "                     behind ('l' in the window toggles)\n"
 		 "",
 		 argv[0], dev_name, frame_count);
 }
 
-static const char short_options[] = "d:hmruofc:v";
+static const char short_options[] = "d:hmruofc:vaSP:wgz:tbL";
 
 static const struct option
 long_options[] = {
@@ -1344,6 +1186,15 @@ long_options[] = {
 	{ "format", no_argument,       NULL, 'f' },
 	{ "count",  required_argument, NULL, 'c' },
 	{ "verbose", no_argument,      NULL, 'v' },
+	{ "ae",     no_argument,       NULL, 'a' },
+	{ "stats",  no_argument,       NULL, 'S' },
+	{ "publish", required_argument, NULL, 'P' },
+	{ "raw",    no_argument,       NULL, 'w' },
+	{ "bayer",  no_argument,       NULL, 'g' },
+	{ "gate",   required_argument, NULL, 'z' },
+	{ "tiles",  no_argument,       NULL, 't' },
+	{ "cheapest", no_argument,     NULL, 'b' },
+	{ "latest", no_argument,       NULL, 'L' },
 	{ 0, 0, 0, 0 }
 };
 
@@ -1402,6 +1253,43 @@ int main(int argc, char **argv)
 
 		case 'v':
 			verbose = 1;
+			logr_level = LOGR_DEBUG;
+			break;
+
+		case 'a':
+			soft_ae = 1;
+			break;
+
+		case 'S':
+			stats_on = 1;
+			break;
+
+		case 'P':
+			pub_path = optarg;
+			break;
+
+		case 'w':
+			pub_raw = 1;
+			break;
+
+		case 'g':
+			use_bayer = 1;
+			break;
+
+		case 'b':
+			use_cheapest = 1;
+			break;
+
+		case 'L':
+			latest_wins = 1;
+			break;
+
+		case 'z':
+			gate_level = atoi(optarg);
+			break;
+
+		case 't':
+			use_tiles = 1;
 			break;
 
 		default:
@@ -1410,18 +1298,68 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* diagnostics leave the capture path as binary records */
+	if (!logring_start(STDERR_FILENO, 100))
+		atexit(logring_stop);
+
 	open_device();
 	init_device();
 
+	if (stats_on) {
+		stats_name = strrchr(dev_name, '/');
+		stats_name = stats_name ? stats_name + 1 : dev_name;
+		stats = shm_stats_create(stats_name, dev_name);
+	}
+
+	if (pub_path) {
+		int r;
+
+		if (pub_raw)
+			r = frame_pub_create(&pub, pub_path, cap.fmt.fmt.pix.width,
+				cap.fmt.fmt.pix.height, cap.fmt.fmt.pix.pixelformat,
+				cap.fmt.fmt.pix.bytesperline, cap.fmt.fmt.pix.sizeimage);
+		else
+			r = frame_pub_create(&pub, pub_path, plan->width,
+				plan->height, V4L2_PIX_FMT_BGR24, plan->dst_stride,
+				plan->out_size);
+		if (r)
+			exit(EXIT_FAILURE);
+	}
+
 	cvNamedWindow(windowname,CV_WINDOW_AUTOSIZE);
 
+	/* frame periods at 10 fps, far past the DQBUF range */
+	latency_init_range(&lat_oldest, "in order", LATENCY_LONG_US);
+	latency_init_range(&lat_latest, "newest", LATENCY_LONG_US);
 	start_capturing();
 	mainloop();
 	stop_capturing();
 
 	cvDestroyWindow(windowname);
 
-	uninit_device();
+	pacing_report(&pacing, stderr);
+	if (lat_oldest.n || lat_latest.n) {
+		fprintf(stderr, "capture to display:\n");
+		latency_report_header(stderr);
+		if (lat_oldest.n)
+			latency_report(&lat_oldest, stderr);
+		if (lat_latest.n)
+			latency_report(&lat_latest, stderr);
+		if (lat_latest.n)
+			fprintf(stderr, "%lu frames skipped for newer ones\n",
+				latest_skipped);
+	}
+	if (gate_on)
+		fprintf(stderr, "change gate: %lu of %lu frames skipped (%.1f%%)\n",
+			gate.skipped, gate.frames,
+			gate.frames ? 100.0 * gate.skipped / gate.frames : 0.0);
+	shm_stats_destroy(stats, stats_name);
+	if (pub_path) {
+		fprintf(stderr, "published %lu frames, %lu notifications skipped\n",
+			pub.published, pub.skipped);
+		frame_pub_destroy(&pub);
+	}
+
 	close_device();
 	
 	fprintf(stderr, "\n");
@@ -11,6 +11,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
 
 #include <getopt.h>             /* getopt_long() */
 
@@ -22,30 +25,54 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
+#include <sys/select.h>
 
 #include <linux/videodev2.h>
 
-#define CLEAR(x) memset(&(x), 0, sizeof(x))
-
-enum io_method {
-        IO_METHOD_READ,
-        IO_METHOD_MMAP,
-        IO_METHOD_USERPTR,
-};
+#include "v4lcapture.h"
+#include "latency.h"
+#include "rt_tune.h"
+#include "prering.h"
+#include "recfile.h"
+#include "splice_out.h"
+#include "y4m.h"
+#include "frameref.h"
 
-struct buffer {
-        void   *start;
-        size_t  length;
-};
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
 
 static char            *dev_name;
 static enum io_method   io = IO_METHOD_MMAP;
-static int              fd = -1;
-struct buffer          *buffers;
-static unsigned int     n_buffers;
+static struct v4lcap    cap;
 static int              out_buf;
+static struct splice_out sout;
+static int              y4m_on;
+static struct y4m_writer y4m;
+static struct frame_pool pool;
+static struct frame_ref *kept[VIDEO_MAX_FRAME];  /* for -k, oldest first */
+static unsigned int     keep_n;
+static unsigned int     n_kept;
 static int              force_format;
 static int              frame_count = 70;
+static int              busy_poll;
+static int              pin_cpu = -1;
+static int              fifo_prio;
+static int              compare;
+static int              lat_on;
+static struct latency   lat_select;
+static struct latency   lat_busy;
+static struct latency  *lat;            /* of the running mode */
+static double           ring_secs;      /* pre-trigger window, 0 = off */
+static double           after_secs = 2;
+static const char      *dump_prefix = "incident";
+static const char      *fifo_path;
+static int              fifo_fd = -1;
+static int              huge_pages;
+static struct prering   ring;
+static const char      *rec_path;
+static struct rec_writer rec;
+static double           grow_mib;       /* queue growth cap, 0 = off */
+
+#define Y4M_BATCH       8       /* frames the consumer may fall behind */
 
 static void errno_exit(const char *s)
 {
@@ -53,123 +80,153 @@ static void errno_exit(const char *s)
         exit(EXIT_FAILURE);
 }
 
-static int xioctl(int fh, int request, void *arg)
-{
-        int r;
-
-        do {
-                r = ioctl(fh, request, arg);
-        } while (-1 == r && EINTR == errno);
-
-        return r;
-}
-
 static void process_image(const void *p, int size)
 {
-        if (out_buf)
-                fwrite(p, size, 1, stdout);
+        (void)p;
+        (void)size;
 
         fflush(stderr);
         fprintf(stderr, ".");
-        fflush(stdout);
 }
 
-static int read_frame(void)
+static void sigusr1(int sig)
 {
-        struct v4l2_buffer buf;
-        unsigned int i;
-
-        switch (io) {
-        case IO_METHOD_READ:
-                if (-1 == read(fd, buffers[0].start, buffers[0].length)) {
-                        switch (errno) {
-                        case EAGAIN:
-                                return 0;
-
-                        case EIO:
-                                /* Could ignore EIO, see spec. */
-
-                                /* fall through */
-
-                        default:
-                                errno_exit("read");
-                        }
-                }
-
-                process_image(buffers[0].start, buffers[0].length);
-                break;
-
-        case IO_METHOD_MMAP:
-                CLEAR(buf);
+        (void)sig;
+        prering_trigger(&ring);
+}
 
-                buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                buf.memory = V4L2_MEMORY_MMAP;
+/* any write to the fifo is a trigger, e.g. echo > fifo */
+static void check_fifo(void)
+{
+        char b[64];
+
+        if (-1 == fifo_fd)
+                return;
+        if (read(fifo_fd, b, sizeof(b)) > 0) {
+                while (read(fifo_fd, b, sizeof(b)) > 0)
+                        ;
+                prering_trigger(&ring);
+        }
+}
 
-                if (-1 == xioctl(fd, VIDIOC_DQBUF, &buf)) {
-                        switch (errno) {
-                        case EAGAIN:
-                                return 0;
+/*
+ * Stands in for an analysis stage that looks back at the last keep_n
+ * frames: it holds them without a copy and lets go of the oldest.
+ */
+static void hold_frame(struct frame_ref *ref)
+{
+        if (!keep_n)
+                return;
+        if (n_kept == keep_n) {
+                if (frame_ref_put(kept[0]))
+                        exit(EXIT_FAILURE);
+                memmove(kept, kept + 1, --n_kept * sizeof(kept[0]));
+        }
+        kept[n_kept++] = frame_ref_get(ref);
+}
 
-                        case EIO:
-                                /* Could ignore EIO, see spec. */
+static void drop_held(void)
+{
+        while (n_kept)
+                if (frame_ref_put(kept[--n_kept]))
+                        exit(EXIT_FAILURE);
+}
 
-                                /* fall through */
+static void keep_frame(const struct v4lcap_frame *frame)
+{
+        if (!ring.mem)
+                return;
+        prering_push(&ring, frame->start, frame->bytesused, &frame->buf);
+}
 
-                        default:
-                                errno_exit("VIDIOC_DQBUF");
-                        }
-                }
+static int read_frame(void)
+{
+        struct v4lcap_frame frame;
+        struct frame_ref *ref;
+        int r;
 
-                assert(buf.index < n_buffers);
+        r = v4lcap_dequeue(&cap, &frame);
+        if (-1 == r)
+                exit(EXIT_FAILURE);
+        if (0 == r)
+                return 0;
+
+        /*
+         * Driver timestamp to DQBUF return: the time a filled buffer waits
+         * for the capture thread, including the wake-up from select().
+         */
+        if (lat)
+                latency_add_since(lat, &frame.buf);
+
+        ref = frame_pool_wrap(&pool, &frame);
+        if (!ref)
+                exit(EXIT_FAILURE);
 
-                process_image(buffers[buf.index].start, buf.bytesused);
+        process_image(frame.start, frame.bytesused);
+        keep_frame(&frame);
+        if (rec_path &&
+            rec_write(&rec, frame.start, frame.bytesused, &frame.buf))
+                exit(EXIT_FAILURE);
 
-                if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-                        errno_exit("VIDIOC_QBUF");
-                break;
+        if (y4m_on && y4m_write(&y4m, frame.start, frame.bytesused))
+                exit(EXIT_FAILURE);
 
-        case IO_METHOD_USERPTR:
-                CLEAR(buf);
+        /* held until the pipe reader has it */
+        if (out_buf && splice_out_frame(&sout, ref))
+                exit(EXIT_FAILURE);
+        hold_frame(ref);
 
-                buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                buf.memory = V4L2_MEMORY_USERPTR;
+        /* back to the driver unless someone else still holds it */
+        if (frame_ref_put(ref))
+                exit(EXIT_FAILURE);
 
-                if (-1 == xioctl(fd, VIDIOC_DQBUF, &buf)) {
-                        switch (errno) {
-                        case EAGAIN:
-                                return 0;
+        return 1;
+}
 
-                        case EIO:
-                                /* Could ignore EIO, see spec. */
+/*
+ * The fd is O_NONBLOCK, so instead of sleeping in select() the capture
+ * thread can spin on DQBUF and take a buffer the moment the driver
+ * marks it done. This burns a whole core, pin it with -p. A device that
+ * stalls gets the same 2 s as in select(), so a SCHED_FIFO spinner does
+ * not keep its core forever.
+ */
+static void busy_loop(void)
+{
+        struct timespec ts, deadline;
+        unsigned int count, spins;
 
-                                /* fall through */
+        count = frame_count;
 
-                        default:
-                                errno_exit("VIDIOC_DQBUF");
+        while (count-- > 0) {
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+                deadline.tv_sec += 2;
+                spins = 0;
+                while (!read_frame()) {
+                        rt_cpu_relax();
+                        /* the clock is cheap, but not free */
+                        if (++spins & 255)
+                                continue;
+                        clock_gettime(CLOCK_MONOTONIC, &ts);
+                        if (ts.tv_sec > deadline.tv_sec ||
+                            (ts.tv_sec == deadline.tv_sec &&
+                             ts.tv_nsec >= deadline.tv_nsec)) {
+                                fprintf(stderr, "busy-poll timeout\n");
+                                exit(EXIT_FAILURE);
                         }
                 }
-
-                for (i = 0; i < n_buffers; ++i)
-                        if (buf.m.userptr == (unsigned long)buffers[i].start
-                            && buf.length == buffers[i].length)
-                                break;
-
-                assert(i < n_buffers);
-
-                process_image((void *)buf.m.userptr, buf.bytesused);
-
-                if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-                        errno_exit("VIDIOC_QBUF");
-                break;
+                check_fifo();
         }
-
-        return 1;
 }
 
 static void mainloop(void)
 {
         unsigned int count;
 
+        if (busy_poll) {
+                busy_loop();
+                return;
+        }
+
         count = frame_count;
 
         while (count-- > 0) {
@@ -179,13 +236,16 @@ static void mainloop(void)
                         int r;
 
                         FD_ZERO(&fds);
-                        FD_SET(fd, &fds);
+                        FD_SET(cap.fd, &fds);
+                        if (-1 != fifo_fd)
+                                FD_SET(fifo_fd, &fds);
 
                         /* Timeout. */
                         tv.tv_sec = 2;
                         tv.tv_usec = 0;
 
-                        r = select(fd + 1, &fds, NULL, NULL, &tv);
+                        r = select((fifo_fd > cap.fd ? fifo_fd : cap.fd) + 1,
+                                   &fds, NULL, NULL, &tv);
 
                         if (-1 == r) {
                                 if (EINTR == errno)
@@ -198,6 +258,9 @@ static void mainloop(void)
                                 exit(EXIT_FAILURE);
                         }
 
+                        if (-1 != fifo_fd && FD_ISSET(fifo_fd, &fds))
+                                check_fifo();
+
                         if (read_frame())
                                 break;
                         /* EAGAIN - continue select loop. */
@@ -207,350 +270,106 @@ static void mainloop(void)
 
 static void stop_capturing(void)
 {
-        enum v4l2_buf_type type;
-
-        switch (io) {
-        case IO_METHOD_READ:
-                /* Nothing to do. */
-                break;
-
-        case IO_METHOD_MMAP:
-        case IO_METHOD_USERPTR:
-                type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                if (-1 == xioctl(fd, VIDIOC_STREAMOFF, &type))
-                        errno_exit("VIDIOC_STREAMOFF");
-                break;
-        }
+        if (v4lcap_stop(&cap))
+                exit(EXIT_FAILURE);
 }
 
 static void start_capturing(void)
 {
-        unsigned int i;
-        enum v4l2_buf_type type;
-
-        switch (io) {
-        case IO_METHOD_READ:
-                /* Nothing to do. */
-                break;
-
-        case IO_METHOD_MMAP:
-                for (i = 0; i < n_buffers; ++i) {
-                        struct v4l2_buffer buf;
-
-                        CLEAR(buf);
-                        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                        buf.memory = V4L2_MEMORY_MMAP;
-                        buf.index = i;
-
-                        if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-                                errno_exit("VIDIOC_QBUF");
-                }
-                type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                if (-1 == xioctl(fd, VIDIOC_STREAMON, &type))
-                        errno_exit("VIDIOC_STREAMON");
-                break;
-
-        case IO_METHOD_USERPTR:
-                for (i = 0; i < n_buffers; ++i) {
-                        struct v4l2_buffer buf;
-
-                        CLEAR(buf);
-                        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                        buf.memory = V4L2_MEMORY_USERPTR;
-                        buf.index = i;
-                        buf.m.userptr = (unsigned long)buffers[i].start;
-                        buf.length = buffers[i].length;
-
-                        if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
-                                errno_exit("VIDIOC_QBUF");
-                }
-                type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                if (-1 == xioctl(fd, VIDIOC_STREAMON, &type))
-                        errno_exit("VIDIOC_STREAMON");
-                break;
-        }
+        if (v4lcap_start(&cap))
+                exit(EXIT_FAILURE);
 }
 
-static void uninit_device(void)
+static void init_device(void)
 {
-        unsigned int i;
-
-        switch (io) {
-        case IO_METHOD_READ:
-                free(buffers[0].start);
-                break;
-
-        case IO_METHOD_MMAP:
-                for (i = 0; i < n_buffers; ++i)
-                        if (-1 == munmap(buffers[i].start, buffers[i].length))
-                                errno_exit("munmap");
-                break;
-
-        case IO_METHOD_USERPTR:
-                for (i = 0; i < n_buffers; ++i)
-                        free(buffers[i].start);
-                break;
-        }
+        struct v4l2_pix_format forced;
 
-        free(buffers);
-}
-
-static void init_read(unsigned int buffer_size)
-{
-        buffers = calloc(1, sizeof(*buffers));
+        CLEAR(forced);
+        forced.width       = 640;
+        forced.height      = 480;
+        forced.pixelformat = V4L2_PIX_FMT_YUYV;
+        forced.field       = V4L2_FIELD_INTERLACED;
 
-        if (!buffers) {
-                fprintf(stderr, "Out of memory\n");
+        if (v4lcap_set_format(&cap, force_format ? &forced : NULL))
                 exit(EXIT_FAILURE);
-        }
-
-        buffers[0].length = buffer_size;
-        buffers[0].start = malloc(buffer_size);
 
-        if (!buffers[0].start) {
-                fprintf(stderr, "Out of memory\n");
+        if (v4lcap_init_buffers(&cap))
                 exit(EXIT_FAILURE);
-        }
 }
 
-static void init_mmap(void)
+/* 0/0 if the driver does not say */
+static struct v4l2_fract frame_interval(void)
 {
-        struct v4l2_requestbuffers req;
-
-        CLEAR(req);
-
-        req.count = 4;
-        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        req.memory = V4L2_MEMORY_MMAP;
-
-        if (-1 == xioctl(fd, VIDIOC_REQBUFS, &req)) {
-                if (EINVAL == errno) {
-                        fprintf(stderr, "%s does not support "
-                                 "memory mapping\n", dev_name);
-                        exit(EXIT_FAILURE);
-                } else {
-                        errno_exit("VIDIOC_REQBUFS");
-                }
-        }
-
-        if (req.count < 2) {
-                fprintf(stderr, "Insufficient buffer memory on %s\n",
-                         dev_name);
-                exit(EXIT_FAILURE);
-        }
-
-        buffers = calloc(req.count, sizeof(*buffers));
+        struct v4l2_streamparm parm;
 
-        if (!buffers) {
-                fprintf(stderr, "Out of memory\n");
-                exit(EXIT_FAILURE);
-        }
-
-        for (n_buffers = 0; n_buffers < req.count; ++n_buffers) {
-                struct v4l2_buffer buf;
-
-                CLEAR(buf);
-
-                buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                buf.memory      = V4L2_MEMORY_MMAP;
-                buf.index       = n_buffers;
-
-                if (-1 == xioctl(fd, VIDIOC_QUERYBUF, &buf))
-                        errno_exit("VIDIOC_QUERYBUF");
-
-                buffers[n_buffers].length = buf.length;
-                buffers[n_buffers].start =
-                        mmap(NULL /* start anywhere */,
-                              buf.length,
-                              PROT_READ | PROT_WRITE /* required */,
-                              MAP_SHARED /* recommended */,
-                              fd, buf.m.offset);
-
-                if (MAP_FAILED == buffers[n_buffers].start)
-                        errno_exit("mmap");
-        }
+        CLEAR(parm);
+        parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        if (-1 == ioctl(cap.fd, VIDIOC_G_PARM, &parm))
+                CLEAR(parm);
+        return parm.parm.capture.timeperframe;
 }
 
-static void init_userp(unsigned int buffer_size)
+static double frame_rate(void)
 {
-        struct v4l2_requestbuffers req;
-
-        CLEAR(req);
-
-        req.count  = 4;
-        req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        req.memory = V4L2_MEMORY_USERPTR;
-
-        if (-1 == xioctl(fd, VIDIOC_REQBUFS, &req)) {
-                if (EINVAL == errno) {
-                        fprintf(stderr, "%s does not support "
-                                 "user pointer i/o\n", dev_name);
-                        exit(EXIT_FAILURE);
-                } else {
-                        errno_exit("VIDIOC_REQBUFS");
-                }
-        }
-
-        buffers = calloc(4, sizeof(*buffers));
-
-        if (!buffers) {
-                fprintf(stderr, "Out of memory\n");
-                exit(EXIT_FAILURE);
-        }
-
-        for (n_buffers = 0; n_buffers < 4; ++n_buffers) {
-                buffers[n_buffers].length = buffer_size;
-                buffers[n_buffers].start = malloc(buffer_size);
+        struct v4l2_fract tpf = frame_interval();
 
-                if (!buffers[n_buffers].start) {
-                        fprintf(stderr, "Out of memory\n");
-                        exit(EXIT_FAILURE);
-                }
-        }
+        if (!tpf.numerator || !tpf.denominator)
+                return 30;
+        return (double)tpf.denominator / tpf.numerator;
 }
 
-static void init_device(void)
+static void init_ring(void)
 {
-        struct v4l2_capability cap;
-        struct v4l2_cropcap cropcap;
-        struct v4l2_crop crop;
-        struct v4l2_format fmt;
-        unsigned int min;
-
-        if (-1 == xioctl(fd, VIDIOC_QUERYCAP, &cap)) {
-                if (EINVAL == errno) {
-                        fprintf(stderr, "%s is no V4L2 device\n",
-                                 dev_name);
-                        exit(EXIT_FAILURE);
-                } else {
-                        errno_exit("VIDIOC_QUERYCAP");
-                }
-        }
+        struct v4l2_fract tpf = frame_interval();
+        double fps = frame_rate();
+        struct sigaction sa;
 
-        if (!(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
-                fprintf(stderr, "%s is no video capture device\n",
-                         dev_name);
+        if (prering_create(&ring, dump_prefix, &cap.fmt, &tpf,
+                           ring_secs * fps + 0.5, after_secs * fps + 0.5,
+                           huge_pages))
                 exit(EXIT_FAILURE);
+        fprintf(stderr, "pre-trigger ring: %u+%u frames, %zu MiB%s, "
+                "trigger with SIGUSR1%s%s\n", ring.pre, ring.post,
+                ring.map_size >> 20, ring.huge ? " in huge pages" : "",
+                fifo_path ? " or a write to " : "",
+                fifo_path ? fifo_path : "");
+
+        CLEAR(sa);
+        sa.sa_handler = sigusr1;
+        sa.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &sa, NULL);
+
+        if (fifo_path) {
+                if (-1 == mkfifo(fifo_path, 0600) && EEXIST != errno)
+                        errno_exit(fifo_path);
+                /* O_RDWR: no EOF when the last writer closes */
+                fifo_fd = open(fifo_path, O_RDWR | O_NONBLOCK);
+                if (-1 == fifo_fd)
+                        errno_exit(fifo_path);
         }
+}
 
-        switch (io) {
-        case IO_METHOD_READ:
-                if (!(cap.capabilities & V4L2_CAP_READWRITE)) {
-                        fprintf(stderr, "%s does not support read i/o\n",
-                                 dev_name);
-                        exit(EXIT_FAILURE);
-                }
-                break;
-
-        case IO_METHOD_MMAP:
-        case IO_METHOD_USERPTR:
-                if (!(cap.capabilities & V4L2_CAP_STREAMING)) {
-                        fprintf(stderr, "%s does not support streaming i/o\n",
-                                 dev_name);
-                        exit(EXIT_FAILURE);
-                }
-                break;
-        }
-
-
-        /* Select video input, video standard and tune here. */
-
-
-        CLEAR(cropcap);
-
-        cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-
-        if (0 == xioctl(fd, VIDIOC_CROPCAP, &cropcap)) {
-                crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-                crop.c = cropcap.defrect; /* reset to default */
-
-                if (-1 == xioctl(fd, VIDIOC_S_CROP, &crop)) {
-                        switch (errno) {
-                        case EINVAL:
-                                /* Cropping not supported. */
-                                break;
-                        default:
-                                /* Errors ignored. */
-                                break;
-                        }
-                }
-        } else {
-                /* Errors ignored. */
-        }
-
-
-        CLEAR(fmt);
-
-        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        if (force_format) {
-                fmt.fmt.pix.width       = 640;
-                fmt.fmt.pix.height      = 480;
-                fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-                fmt.fmt.pix.field       = V4L2_FIELD_INTERLACED;
-
-                if (-1 == xioctl(fd, VIDIOC_S_FMT, &fmt))
-                        errno_exit("VIDIOC_S_FMT");
-
-                /* Note VIDIOC_S_FMT may change width and height. */
-        } else {
-                /* Preserve original settings as set by v4l2-ctl for example */
-                if (-1 == xioctl(fd, VIDIOC_G_FMT, &fmt))
-                        errno_exit("VIDIOC_G_FMT");
-        }
-
-        /* Buggy driver paranoia. */
-        min = fmt.fmt.pix.width * 2;
-        if (fmt.fmt.pix.bytesperline < min)
-                fmt.fmt.pix.bytesperline = min;
-        min = fmt.fmt.pix.bytesperline * fmt.fmt.pix.height;
-        if (fmt.fmt.pix.sizeimage < min)
-                fmt.fmt.pix.sizeimage = min;
-
-        switch (io) {
-        case IO_METHOD_READ:
-                init_read(fmt.fmt.pix.sizeimage);
-                break;
-
-        case IO_METHOD_MMAP:
-                init_mmap();
-                break;
-
-        case IO_METHOD_USERPTR:
-                init_userp(fmt.fmt.pix.sizeimage);
-                break;
-        }
+static void close_ring(void)
+{
+        if (!ring.mem)
+                return;
+        prering_destroy(&ring);
+        fprintf(stderr, "%u dumps, %lu frames refused, %lu triggers "
+                "ignored\n", ring.dumps, ring.overruns, ring.ignored);
+        if (-1 != fifo_fd)
+                close(fifo_fd);
 }
 
 static void close_device(void)
 {
-        if (-1 == close(fd))
-                errno_exit("close");
-
-        fd = -1;
+        if (v4lcap_close(&cap))
+                exit(EXIT_FAILURE);
 }
 
 static void open_device(void)
 {
-        struct stat st;
-
-        if (-1 == stat(dev_name, &st)) {
-                fprintf(stderr, "Cannot identify '%s': %d, %s\n",
-                         dev_name, errno, strerror(errno));
-                exit(EXIT_FAILURE);
-        }
-
-        if (!S_ISCHR(st.st_mode)) {
-                fprintf(stderr, "%s is no device\n", dev_name);
-                exit(EXIT_FAILURE);
-        }
-
-        fd = open(dev_name, O_RDWR /* required */ | O_NONBLOCK, 0);
-
-        if (-1 == fd) {
-                fprintf(stderr, "Cannot open '%s': %d, %s\n",
-                         dev_name, errno, strerror(errno));
+        if (v4lcap_open(&cap, dev_name, io))
                 exit(EXIT_FAILURE);
-        }
 }
 
 static void usage(FILE *fp, int argc, char **argv)
@@ -564,14 +383,35 @@ static void usage(FILE *fp, int argc, char **argv)
                  "-m | --mmap          Use memory mapped buffers [default]\n"
                  "-r | --read          Use read() calls\n"
                  "-u | --userp         Use application allocated buffers\n"
-                 "-o | --output        Outputs stream to stdout\n"
+                 "-o | --output        Outputs stream to stdout, without\n"
+                 "                     copying if it is a pipe\n"
                  "-f | --format        Force format to 640x480 YUYV\n"
                  "-c | --count         Number of frames to grab [%i]\n"
+                 "-b | --busy-poll     Spin on DQBUF instead of select()\n"
+                 "-p | --cpu n         Pin the capture thread to cpu n\n"
+                 "-F | --fifo prio     Run the capture thread SCHED_FIFO\n"
+                 "-l | --latency       Report the DQBUF latency distribution\n"
+                 "-C | --compare       Grab count frames with select(), then\n"
+                 "                     count with busy-poll, and compare\n"
+                 "-R | --ring secs     Keep the last secs of raw frames for\n"
+                 "                     a trigger (SIGUSR1, -T)\n"
+                 "-A | --after secs    Frames after the trigger to save [%.0f]\n"
+                 "-D | --dump prefix   Save triggered frames to prefix-NNN.v4r\n"
+                 "                     [%s]\n"
+                 "-T | --trigger fifo  Trigger on writes to this fifo\n"
+                 "-H | --hugepages     Back the ring with huge pages\n"
+                 "-O | --record file   Record to an indexed file (- = stdout),\n"
+                 "                     see recplay\n"
+                 "-y | --y4m           Outputs YUV4MPEG2 to stdout, e.g. for\n"
+                 "                     | ffmpeg -i - or | mpv -\n"
+                 "-k | --keep n        Hold on to the last n frames, as an\n"
+                 "                     analysis stage would (see -l)\n"
+                 "-g | --grow MiB      Add mmap buffers on drops, up to MiB\n"
                  "",
-                 argv[0], dev_name, frame_count);
+                 argv[0], dev_name, frame_count, after_secs, dump_prefix);
 }
 
-static const char short_options[] = "d:hmruofc:";
+static const char short_options[] = "d:hmruofc:bp:F:lCR:A:D:T:HO:yk:g:";
 
 static const struct option
 long_options[] = {
@@ -583,6 +423,20 @@ long_options[] = {
         { "output", no_argument,       NULL, 'o' },
         { "format", no_argument,       NULL, 'f' },
         { "count",  required_argument, NULL, 'c' },
+        { "busy-poll", no_argument,    NULL, 'b' },
+        { "cpu",    required_argument, NULL, 'p' },
+        { "fifo",   required_argument, NULL, 'F' },
+        { "latency", no_argument,      NULL, 'l' },
+        { "compare", no_argument,      NULL, 'C' },
+        { "ring",   required_argument, NULL, 'R' },
+        { "after",  required_argument, NULL, 'A' },
+        { "dump",   required_argument, NULL, 'D' },
+        { "trigger", required_argument, NULL, 'T' },
+        { "hugepages", no_argument,    NULL, 'H' },
+        { "record", required_argument, NULL, 'O' },
+        { "y4m",    no_argument,       NULL, 'y' },
+        { "keep",   required_argument, NULL, 'k' },
+        { "grow",   required_argument, NULL, 'g' },
         { 0, 0, 0, 0 }
 };
 
@@ -639,19 +493,160 @@ int main(int argc, char **argv)
                                 errno_exit(optarg);
                         break;
 
+                case 'b':
+                        busy_poll++;
+                        lat_on++;
+                        break;
+
+                case 'p':
+                        pin_cpu = atoi(optarg);
+                        break;
+
+                case 'F':
+                        fifo_prio = atoi(optarg);
+                        break;
+
+                case 'l':
+                        lat_on++;
+                        break;
+
+                case 'C':
+                        compare++;
+                        lat_on++;
+                        break;
+
+                case 'R':
+                        ring_secs = atof(optarg);
+                        break;
+
+                case 'A':
+                        after_secs = atof(optarg);
+                        break;
+
+                case 'D':
+                        dump_prefix = optarg;
+                        break;
+
+                case 'T':
+                        fifo_path = optarg;
+                        break;
+
+                case 'H':
+                        huge_pages++;
+                        break;
+
+                case 'O':
+                        rec_path = optarg;
+                        break;
+
+                case 'y':
+                        y4m_on++;
+                        break;
+
+                case 'k':
+                        keep_n = atoi(optarg);
+                        break;
+
+                case 'g':
+                        grow_mib = atof(optarg);
+                        break;
+
                 default:
                         usage(stderr, argc, argv);
                         exit(EXIT_FAILURE);
                 }
         }
 
+        if (pin_cpu >= 0 && rt_pin_cpu(pin_cpu))
+                exit(EXIT_FAILURE);
+        if (fifo_prio && rt_sched_fifo(fifo_prio))
+                exit(EXIT_FAILURE);
+
+        latency_init(&lat_select, "select");
+        latency_init(&lat_busy, "busy-poll");
+
         open_device();
+        if (grow_mib > 0 && v4lcap_set_growth(&cap, grow_mib * (1 << 20)))
+                exit(EXIT_FAILURE);
         init_device();
+        if (ring_secs > 0)
+                init_ring();
+        if (rec_path) {
+                struct v4l2_fract tpf = frame_interval();
+
+                if (rec_create(&rec, rec_path, &cap.fmt, &tpf))
+                        exit(EXIT_FAILURE);
+        }
+        if (frame_pool_init(&pool, &cap))
+                exit(EXIT_FAILURE);
+        /* the driver needs one to fill, and read() has only one */
+        if (keep_n && keep_n + 1 > cap.n_buffers) {
+                keep_n = IO_METHOD_READ == io ? 0 : cap.n_buffers - 1;
+                fprintf(stderr, "holding %u frames at most\n", keep_n);
+        }
+        if (y4m_on && out_buf) {
+                fprintf(stderr, "-y and -o both write to stdout\n");
+                exit(EXIT_FAILURE);
+        }
+        if (y4m_on) {
+                struct v4l2_fract tpf = frame_interval();
+
+                if (y4m_open(&y4m, STDOUT_FILENO, &cap.fmt, &tpf, Y4M_BATCH))
+                        exit(EXIT_FAILURE);
+        }
+        if (out_buf && splice_out_init(&sout, STDOUT_FILENO, &cap))
+                exit(EXIT_FAILURE);
         start_capturing();
-        mainloop();
+        if (compare) {
+                busy_poll = 0;
+                lat = &lat_select;
+                mainloop();
+                busy_poll = 1;
+                lat = &lat_busy;
+                mainloop();
+        } else {
+                if (lat_on)
+                        lat = busy_poll ? &lat_busy : &lat_select;
+                mainloop();
+        }
+        if (out_buf && splice_out_flush(&sout))
+                exit(EXIT_FAILURE);
+        drop_held();
         stop_capturing();
-        uninit_device();
+        close_ring();
+        if (rec_path && rec_close(&rec))
+                exit(EXIT_FAILURE);
+        if (y4m_on && y4m_close(&y4m))
+                exit(EXIT_FAILURE);
+        frame_pool_release(&pool);
         close_device();
         fprintf(stderr, "\n");
+        if (out_buf)
+                fprintf(stderr, "%lu frames out, %lu copied, %lu waits for "
+                        "the reader\n", sout.frames, sout.copied, sout.waits);
+        if (y4m_on)
+                fprintf(stderr, "%lu Y4M frames in %lu writes, up to %u "
+                        "at once\n", y4m.frames, y4m.writes, y4m.max_pending);
+        if (grow_mib > 0)
+                fprintf(stderr, "%lu frames lost, %lu times starved; %lu "
+                        "buffers created, %lu reused, %lu parked, %lu "
+                        "removed\n", cap.grow.lost, cap.grow.starved,
+                        cap.grow.created, cap.grow.unparked, cap.grow.parked,
+                        cap.grow.removed);
+
+        if (lat_on) {
+                latency_report_header(stderr);
+                if (lat_select.n)
+                        latency_report(&lat_select, stderr);
+                if (lat_busy.n)
+                        latency_report(&lat_busy, stderr);
+                if (pool.hold.n)
+                        latency_report(&pool.hold, stderr);
+                if (!lat_select.n && !lat_busy.n)
+                        fprintf(stderr, "no monotonic timestamps, "
+                                "latency not measured\n");
+                fprintf(stderr, "up to %u buffers held at once\n",
+                        pool.max_out);
+        }
         return 0;
 }
@@ -0,0 +1,119 @@
+/*
+ *  Frame-time-budgeted software exposure controller
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <string.h>
+
+#include "exposure_ctl.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+static int clamp(int v, int lo, int hi)
+{
+	if (v < lo)
+		return lo;
+	if (v > hi)
+		return hi;
+	return v;
+}
+
+/* gain control value -> linear factor, 1.0 at gain_min */
+static double gain_to_factor(const struct exposure_ctl *ec, int gain)
+{
+	if (ec->gain_max <= ec->gain_min)
+		return 1.0;
+	return 1.0 + (double)(gain - ec->gain_min) * (EXPOSURE_GAIN_FACTOR - 1)
+		/ (ec->gain_max - ec->gain_min);
+}
+
+static int factor_to_gain(const struct exposure_ctl *ec, double f)
+{
+	if (ec->gain_max <= ec->gain_min)
+		return ec->gain_min;
+	return ec->gain_min + (int)((f - 1.0) * (ec->gain_max - ec->gain_min)
+		/ (EXPOSURE_GAIN_FACTOR - 1) + 0.5);
+}
+
+void exposure_ctl_init(struct exposure_ctl *ec, unsigned int fps,
+		       int exp_min, int exp_max, int gain_min, int gain_max,
+		       int exposure, int gain)
+{
+	CLEAR(*ec);
+
+	/*
+	1/fps in 100us units, less 10% for sensor readout, e.g. 30fps gives
+	333 -> 300.
+	*/
+	ec->budget = fps ? (int)(10000 * 9 / (10 * fps)) : exp_max;
+	ec->exp_min = exp_min > 0 ? exp_min : 1;
+	ec->exp_max = exp_max < ec->budget ? exp_max : ec->budget;
+	if (ec->exp_max < ec->exp_min)
+		ec->exp_max = ec->exp_min;
+	ec->gain_min = gain_min;
+	ec->gain_max = gain_max;
+	ec->exposure = clamp(exposure, ec->exp_min, ec->exp_max);
+	ec->gain = gain_max > gain_min ? clamp(gain, gain_min, gain_max)
+				       : gain_min;
+	ec->target = EXPOSURE_TARGET;
+}
+
+int exposure_ctl_update(struct exposure_ctl *ec, const unsigned int *hist,
+			int *exposure, int *gain)
+{
+	unsigned long long sum = 0, n = 0, clipped;
+	double ratio, total, g;
+	int i, e;
+
+	if (ec->settle) {
+		ec->settle--;
+		return 0;
+	}
+
+	for (i = 0; i < 256; i++) {
+		sum += (unsigned long long)hist[i] * i;
+		n += hist[i];
+	}
+	if (!n)
+		return 0;
+	clipped = hist[255] + hist[254];
+
+	ec->mean = (double)sum / n;
+	if (ec->mean > ec->target - EXPOSURE_DEADBAND &&
+	    ec->mean < ec->target + EXPOSURE_DEADBAND && clipped * 50 < n)
+		return 0;
+
+	/* half way to the target per step, at most 2x either way */
+	ratio = ec->target / (ec->mean > 1.0 ? ec->mean : 1.0);
+	ratio = 1.0 + (ratio - 1.0) / 2;
+	if (ratio > 2.0)
+		ratio = 2.0;
+	if (ratio < 0.5)
+		ratio = 0.5;
+	/* highlights blown out: always come down */
+	if (clipped * 50 >= n && ratio > 0.9)
+		ratio = 0.9;
+
+	/* exposure first, up to the frame budget, then gain */
+	total = ec->exposure * gain_to_factor(ec, ec->gain) * ratio;
+	e = clamp((int)(total + 0.5), ec->exp_min, ec->exp_max);
+	g = total / e;
+	if (g < 1.0)
+		g = 1.0;
+	if (g > EXPOSURE_GAIN_FACTOR)
+		g = EXPOSURE_GAIN_FACTOR;
+
+	*exposure = e;
+	*gain = factor_to_gain(ec, g);
+	if (ec->gain_max > ec->gain_min)
+		*gain = clamp(*gain, ec->gain_min, ec->gain_max);
+
+	if (*exposure == ec->exposure && *gain == ec->gain)
+		return 0;
+
+	ec->exposure = *exposure;
+	ec->gain = *gain;
+	ec->settle = EXPOSURE_SETTLE;
+	return 1;
+}
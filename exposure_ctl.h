@@ -0,0 +1,46 @@
+/*
+ *  Frame-time-budgeted software exposure controller
+ *
+ *  The exposure time is limited by the frame interval: if the sensor is
+ *  asked to expose longer than 1/fps, the camera drops its frame rate.
+ *  This controller meters the luma histogram of each frame and keeps the
+ *  exposure inside the frame interval budget, making up the rest of the
+ *  required brightness with analog gain.
+ */
+
+#ifndef EXPOSURE_CTL_H
+#define EXPOSURE_CTL_H
+
+#define EXPOSURE_TARGET		110	/* mean luma we aim for */
+#define EXPOSURE_DEADBAND	8	/* +/- luma considered on target */
+#define EXPOSURE_SETTLE		3	/* frames until a new setting shows */
+#define EXPOSURE_GAIN_FACTOR	8	/* assumed linear gain at gain max */
+
+struct exposure_ctl {
+	int	budget;		/* longest exposure, 100us units */
+	int	exp_min, exp_max;
+	int	gain_min, gain_max;
+	int	exposure;	/* currently applied values */
+	int	gain;
+	int	target;
+	int	settle;		/* frames to skip before metering again */
+	double	mean;		/* last metered mean luma */
+};
+
+/*
+ * fps is the negotiated frame rate (see GetFPSParam()), the ranges are
+ * those reported by VIDIOC_QUERYCTRL. gain_max <= gain_min means the
+ * camera has no gain control and only the exposure is regulated.
+ */
+void exposure_ctl_init(struct exposure_ctl *ec, unsigned int fps,
+		       int exp_min, int exp_max, int gain_min, int gain_max,
+		       int exposure, int gain);
+
+/*
+ * Meter a 256-bin luma histogram. Returns 1 with new values in
+ * *exposure and *gain if they should be applied, 0 otherwise.
+ */
+int exposure_ctl_update(struct exposure_ctl *ec, const unsigned int *hist,
+			int *exposure, int *gain);
+
+#endif /* EXPOSURE_CTL_H */
@@ -0,0 +1,99 @@
+/*
+ *  Frame pacing and jitter analysis from driver timestamps
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "frame_pacing.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+void pacing_init(struct frame_pacing *fp, const struct v4l2_fract *timeperframe)
+{
+	CLEAR(*fp);
+	if (timeperframe && timeperframe->denominator)
+		fp->nominal = 1000000.0 * timeperframe->numerator
+			/ timeperframe->denominator;
+}
+
+int pacing_update(struct frame_pacing *fp, const struct v4l2_buffer *buf)
+{
+	uint64_t ts;
+	uint32_t gap;
+	double dt, delta, off;
+	int ret = 0;
+
+	ts = (uint64_t)buf->timestamp.tv_sec * 1000000 + buf->timestamp.tv_usec;
+	if (!fp->frames++ || ts <= fp->last_ts) {
+		fp->last_ts = ts;
+		fp->last_seq = buf->sequence;
+		return 0;
+	}
+
+	/* frames the driver dropped in between show up as sequence gaps */
+	gap = buf->sequence - fp->last_seq;
+	if (gap > 1)
+		fp->lost += gap - 1;
+	else
+		gap = 1;
+	dt = (double)(ts - fp->last_ts) / gap;
+	fp->last_ts = ts;
+	fp->last_seq = buf->sequence;
+
+	fp->n++;
+	delta = dt - fp->mean;
+	fp->mean += delta / fp->n;
+	fp->m2 += delta * (dt - fp->mean);
+	if (fp->n == 1 || dt < fp->min)
+		fp->min = dt;
+	if (dt > fp->max)
+		fp->max = dt;
+	fp->avg = fp->n == 1 ? dt : fp->avg + (dt - fp->avg) / 16;
+
+	if (!fp->nominal)
+		return 0;
+
+	if (dt > fp->nominal * PACING_LATE)
+		fp->late++;
+	else if (dt < fp->nominal * PACING_EARLY)
+		fp->early++;
+
+	/* wait for the moving average to fill before judging the rate */
+	if (fp->n < 16)
+		return 0;
+	off = fabs(fp->avg - fp->nominal) / fp->nominal;
+	if (!fp->rate_changed && off > PACING_RATE_OFF) {
+		fp->rate_changed = 1;
+		fp->rate_changes++;
+		ret = 1;
+	} else if (fp->rate_changed && off < PACING_RATE_ON) {
+		fp->rate_changed = 0;
+		ret = -1;
+	}
+	return ret;
+}
+
+double pacing_jitter(const struct frame_pacing *fp)
+{
+	return fp->n > 1 ? sqrt(fp->m2 / (fp->n - 1)) : 0.0;
+}
+
+void pacing_report(const struct frame_pacing *fp, FILE *f)
+{
+	if (!fp->n)
+		return;
+	fprintf(f, "Frame pacing (%lu frames):\n"
+		"  Nominal: %.0f us\n"
+		"  Mean: %.0f us (%.2f fps)\n"
+		"  Jitter: %.0f us\n"
+		"  Min/Max: %.0f/%.0f us\n"
+		"  Late: %lu Early: %lu Lost: %lu\n"
+		"  Rate changes: %lu%s\n",
+		fp->frames, fp->nominal, fp->mean, 1000000.0 / fp->mean,
+		pacing_jitter(fp), fp->min, fp->max,
+		fp->late, fp->early, fp->lost,
+		fp->rate_changes, fp->rate_changed ? " (still off)" : "");
+}
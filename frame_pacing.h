@@ -0,0 +1,50 @@
+/*
+ *  Frame pacing and jitter analysis from driver timestamps
+ *
+ *  v4l2_buffer.timestamp is taken by the driver when the frame was
+ *  captured, so unlike the time process_image() runs at it is not skewed
+ *  by scheduling. Successive timestamps are compared with the interval
+ *  negotiated through VIDIOC_S_PARM/VIDIOC_G_PARM.
+ */
+
+#ifndef FRAME_PACING_H
+#define FRAME_PACING_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <linux/videodev2.h>
+
+#define PACING_LATE		1.25	/* interval > nominal * 1.25 is late */
+#define PACING_EARLY		0.75	/* interval < nominal * 0.75 is early */
+#define PACING_RATE_OFF		0.15	/* average off by 15%: rate changed */
+#define PACING_RATE_ON		0.05	/* back within 5%: rate restored */
+
+struct frame_pacing {
+	double		nominal;	/* us, 0 if unknown */
+	uint64_t	last_ts;	/* us */
+	uint32_t	last_seq;
+	unsigned long	frames;
+	unsigned long	n;		/* intervals measured */
+	double		mean;		/* us, running (Welford) */
+	double		m2;
+	double		min, max;
+	double		avg;		/* us, moving average */
+	unsigned long	late, early, lost;
+	int		rate_changed;	/* currently running off nominal */
+	unsigned long	rate_changes;
+};
+
+void pacing_init(struct frame_pacing *fp, const struct v4l2_fract *timeperframe);
+
+/*
+ * Account one dequeued buffer. Returns 1 if the camera has just been
+ * detected running at a rate other than the negotiated one, -1 if it has
+ * just come back to it, 0 otherwise.
+ */
+int pacing_update(struct frame_pacing *fp, const struct v4l2_buffer *buf);
+
+double pacing_jitter(const struct frame_pacing *fp);
+
+void pacing_report(const struct frame_pacing *fp, FILE *f);
+
+#endif /* FRAME_PACING_H */
@@ -0,0 +1,322 @@
+/*
+ *  Zero-copy frame fan-out to local processes
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#define _GNU_SOURCE		/* accept4() */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+#include <linux/memfd.h>
+
+#include "frame_pub.h"
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS	1033
+#define F_SEAL_SHRINK	0x0002
+#define F_SEAL_GROW	0x0004
+#endif
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+#define PAGE_ALIGN(x) (((x) + 4095) & ~(size_t)4095)
+
+static int sys_memfd_create(const char *name, unsigned int flags)
+{
+	return syscall(SYS_memfd_create, name, flags);
+}
+
+int frame_pub_create(struct frame_pub *fp, const char *path,
+		     unsigned int width, unsigned int height,
+		     uint32_t pixelformat, unsigned int bytesperline,
+		     size_t frame_size)
+{
+	struct sockaddr_un addr;
+	struct frame_ring *ring;
+	size_t slot_size;
+
+	CLEAR(*fp);
+	fp->listen_fd = -1;
+	fp->memfd = -1;
+
+	slot_size = PAGE_ALIGN(frame_size);
+	fp->map_size = PAGE_ALIGN(sizeof(*ring)) + FRAME_PUB_SLOTS * slot_size;
+
+	fp->memfd = sys_memfd_create("v4l-capture-frames",
+				     MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (-1 == fp->memfd) {
+		perror("memfd_create");
+		return -1;
+	}
+	if (-1 == ftruncate(fp->memfd, fp->map_size)) {
+		perror("ftruncate");
+		goto err;
+	}
+	/* subscribers may rely on the size staying put */
+	fcntl(fp->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+
+	ring = mmap(NULL, fp->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fp->memfd, 0);
+	if (MAP_FAILED == ring) {
+		perror("mmap");
+		goto err;
+	}
+	fp->ring = ring;
+	ring->magic = FRAME_PUB_MAGIC;
+	ring->version = FRAME_PUB_VERSION;
+	ring->nslots = FRAME_PUB_SLOTS;
+	ring->slot_size = slot_size;
+	ring->data_offset = PAGE_ALIGN(sizeof(*ring));
+	ring->width = width;
+	ring->height = height;
+	ring->pixelformat = pixelformat;
+	ring->bytesperline = bytesperline;
+
+	fp->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK
+			       | SOCK_CLOEXEC, 0);
+	if (-1 == fp->listen_fd) {
+		perror("socket");
+		goto err;
+	}
+	CLEAR(addr);
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	strncpy(fp->path, path, sizeof(fp->path) - 1);
+	unlink(path);
+	if (-1 == bind(fp->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    -1 == listen(fp->listen_fd, FRAME_PUB_MAX_SUBS)) {
+		perror(path);
+		goto err;
+	}
+	return 0;
+
+err:
+	frame_pub_destroy(fp);
+	return -1;
+}
+
+void frame_pub_destroy(struct frame_pub *fp)
+{
+	unsigned int i;
+
+	for (i = 0; i < fp->n_subs; i++)
+		close(fp->subs[i]);
+	fp->n_subs = 0;
+	if (-1 != fp->listen_fd) {
+		close(fp->listen_fd);
+		unlink(fp->path);
+	}
+	if (fp->ring)
+		munmap(fp->ring, fp->map_size);
+	if (-1 != fp->memfd)
+		close(fp->memfd);
+	fp->listen_fd = -1;
+	fp->memfd = -1;
+	fp->ring = NULL;
+}
+
+/* hand the memfd to a new subscriber */
+static int send_memfd(int sock, int memfd, uint64_t map_size)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} u;
+
+	CLEAR(msg);
+	CLEAR(u);
+	iov.iov_base = &map_size;
+	iov.iov_len = sizeof(map_size);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = u.buf;
+	msg.msg_controllen = sizeof(u.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+
+	return sendmsg(sock, &msg, MSG_NOSIGNAL) == sizeof(map_size) ? 0 : -1;
+}
+
+void frame_pub_accept(struct frame_pub *fp)
+{
+	int sock;
+
+	for (;;) {
+		sock = accept4(fp->listen_fd, NULL, NULL,
+			       SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (-1 == sock)
+			return;
+		if (fp->n_subs >= FRAME_PUB_MAX_SUBS ||
+		    send_memfd(sock, fp->memfd, fp->map_size)) {
+			close(sock);
+			continue;
+		}
+		fp->subs[fp->n_subs++] = sock;
+	}
+}
+
+void *frame_pub_slot(struct frame_pub *fp)
+{
+	struct frame_ring_slot *s = &fp->ring->slot[fp->next];
+	uint32_t gen = s->gen;
+
+	/* odd: a subscriber still reading the old frame will notice */
+	if (!(gen & 1)) {
+		__atomic_store_n(&s->gen, gen + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+	}
+	return (char *)fp->ring + fp->ring->data_offset
+		+ (size_t)fp->next * fp->ring->slot_size;
+}
+
+void frame_pub_commit(struct frame_pub *fp, size_t size, uint32_t sequence,
+		      uint64_t timestamp)
+{
+	struct frame_ring_slot *s = &fp->ring->slot[fp->next];
+	struct frame_pub_msg msg;
+	unsigned int i;
+	uint32_t gen;
+
+	/* frame_pub_slot() marked the slot busy (odd) before it was filled */
+	gen = s->gen | 1;
+	s->size = size;
+	s->sequence = sequence;
+	s->timestamp = timestamp;
+	__atomic_store_n(&s->gen, gen + 1, __ATOMIC_RELEASE);
+
+	msg.slot = fp->next;
+	msg.gen = gen + 1;
+	for (i = 0; i < fp->n_subs; ) {
+		if (send(fp->subs[i], &msg, sizeof(msg),
+			 MSG_DONTWAIT | MSG_NOSIGNAL) == sizeof(msg)) {
+			i++;
+		} else if (EAGAIN == errno || EWOULDBLOCK == errno) {
+			/* slow subscriber: skip it, never block capture */
+			fp->skipped++;
+			i++;
+		} else {
+			close(fp->subs[i]);
+			fp->subs[i] = fp->subs[--fp->n_subs];
+		}
+	}
+
+	fp->published++;
+	fp->next = (fp->next + 1) % fp->ring->nslots;
+}
+
+int frame_sub_connect(struct frame_sub *fs, const char *path)
+{
+	struct sockaddr_un addr;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} u;
+	uint64_t map_size;
+	int memfd = -1;
+	void *p;
+
+	CLEAR(*fs);
+	fs->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (-1 == fs->fd) {
+		perror("socket");
+		return -1;
+	}
+	CLEAR(addr);
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	if (-1 == connect(fs->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		perror(path);
+		goto err;
+	}
+
+	CLEAR(msg);
+	iov.iov_base = &map_size;
+	iov.iov_len = sizeof(map_size);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = u.buf;
+	msg.msg_controllen = sizeof(u.buf);
+	if (recvmsg(fs->fd, &msg, MSG_CMSG_CLOEXEC) != sizeof(map_size)) {
+		fprintf(stderr, "%s: no frame ring offered\n", path);
+		goto err;
+	}
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS) {
+		fprintf(stderr, "%s: no frame ring offered\n", path);
+		goto err;
+	}
+	memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+
+	p = mmap(NULL, map_size, PROT_READ, MAP_SHARED, memfd, 0);
+	close(memfd);
+	if (MAP_FAILED == p) {
+		perror("mmap");
+		goto err;
+	}
+	fs->ring = p;
+	fs->map_size = map_size;
+	if (fs->ring->magic != FRAME_PUB_MAGIC ||
+	    fs->ring->version != FRAME_PUB_VERSION) {
+		fprintf(stderr, "%s: frame ring version mismatch\n", path);
+		goto err;
+	}
+	return 0;
+
+err:
+	frame_sub_close(fs);
+	return -1;
+}
+
+void frame_sub_close(struct frame_sub *fs)
+{
+	if (fs->ring)
+		munmap((void *)fs->ring, fs->map_size);
+	if (-1 != fs->fd)
+		close(fs->fd);
+	fs->ring = NULL;
+	fs->fd = -1;
+}
+
+int frame_sub_wait(struct frame_sub *fs, struct frame_pub_msg *msg)
+{
+	ssize_t r;
+
+	do {
+		r = recv(fs->fd, msg, sizeof(*msg), 0);
+	} while (-1 == r && EINTR == errno);
+
+	if (r != sizeof(*msg) || msg->slot >= fs->ring->nslots)
+		return -1;
+	return 0;
+}
+
+const void *frame_sub_data(const struct frame_sub *fs, unsigned int slot)
+{
+	return (const char *)fs->ring + fs->ring->data_offset
+		+ (size_t)slot * fs->ring->slot_size;
+}
+
+int frame_sub_valid(const struct frame_sub *fs, const struct frame_pub_msg *msg)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&fs->ring->slot[msg->slot].gen,
+			       __ATOMIC_RELAXED) == msg->gen;
+}
@@ -0,0 +1,107 @@
+/*
+ *  Zero-copy frame fan-out to local processes
+ *
+ *  The publisher keeps a ring of frame slots in one memfd. A subscriber
+ *  connects to a unix socket, receives the memfd once (SCM_RIGHTS) and
+ *  maps it read-only; after that every frame costs the publisher one
+ *  small non-blocking notification per subscriber, and the subscriber
+ *  reads the frame in place.
+ *
+ *  The publisher never waits. A subscriber whose socket is full misses
+ *  notifications, and one that is still reading a slot when the ring
+ *  wraps finds the slot generation changed and drops that frame.
+ */
+
+#ifndef FRAME_PUB_H
+#define FRAME_PUB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FRAME_PUB_MAGIC		0x4250564c	/* "LVPB" */
+#define FRAME_PUB_VERSION	1
+#define FRAME_PUB_SLOTS		8
+#define FRAME_PUB_MAX_SUBS	16
+
+struct frame_ring_slot {
+	uint32_t	gen;		/* odd while the slot is written */
+	uint32_t	size;		/* bytes used */
+	uint32_t	sequence;	/* v4l2_buffer.sequence */
+	uint32_t	reserved;
+	uint64_t	timestamp;	/* us, driver timestamp */
+};
+
+/* header at offset 0 of the memfd, frame data from data_offset on */
+struct frame_ring {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	nslots;
+	uint32_t	slot_size;	/* distance between slots */
+	uint32_t	data_offset;
+	uint32_t	width;
+	uint32_t	height;
+	uint32_t	pixelformat;	/* V4L2_PIX_FMT_* of the slot data */
+	uint32_t	bytesperline;
+	uint32_t	reserved[7];
+	struct frame_ring_slot slot[FRAME_PUB_SLOTS];
+};
+
+/* datagram sent to subscribers for each frame */
+struct frame_pub_msg {
+	uint32_t	slot;
+	uint32_t	gen;
+};
+
+struct frame_pub {
+	int		listen_fd;	/* add to select() readfds */
+	int		memfd;
+	struct frame_ring *ring;
+	size_t		map_size;
+	unsigned int	next;		/* slot being filled */
+	int		subs[FRAME_PUB_MAX_SUBS];
+	unsigned int	n_subs;
+	unsigned long	published;
+	unsigned long	skipped;	/* notifications dropped, slow subscriber */
+	char		path[108];
+};
+
+struct frame_sub {
+	int		fd;
+	const struct frame_ring *ring;
+	size_t		map_size;
+};
+
+/* Publisher */
+
+int frame_pub_create(struct frame_pub *fp, const char *path,
+		     unsigned int width, unsigned int height,
+		     uint32_t pixelformat, unsigned int bytesperline,
+		     size_t frame_size);
+
+void frame_pub_destroy(struct frame_pub *fp);
+
+/* listen_fd is readable: take new subscribers */
+void frame_pub_accept(struct frame_pub *fp);
+
+/* Slot to write the next frame into, e.g. the conversion target. */
+void *frame_pub_slot(struct frame_pub *fp);
+
+/* Frame in frame_pub_slot() is complete: hand it to the subscribers. */
+void frame_pub_commit(struct frame_pub *fp, size_t size, uint32_t sequence,
+		      uint64_t timestamp);
+
+/* Subscriber */
+
+int frame_sub_connect(struct frame_sub *fs, const char *path);
+
+void frame_sub_close(struct frame_sub *fs);
+
+/* Blocks for the next notification. Returns 0, or -1 on disconnect. */
+int frame_sub_wait(struct frame_sub *fs, struct frame_pub_msg *msg);
+
+const void *frame_sub_data(const struct frame_sub *fs, unsigned int slot);
+
+/* After reading: 1 if the slot was not overwritten meanwhile. */
+int frame_sub_valid(const struct frame_sub *fs, const struct frame_pub_msg *msg);
+
+#endif /* FRAME_PUB_H */
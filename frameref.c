@@ -0,0 +1,78 @@
+/*
+ *  Reference-counted frame handles
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "frameref.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int frame_pool_init(struct frame_pool *fp, struct v4lcap *cap)
+{
+	CLEAR(*fp);
+	fp->cap = cap;
+	/* up to -k frame periods and more, not DQBUF microseconds */
+	latency_init_range(&fp->hold, "held", LATENCY_LONG_US);
+	return pthread_mutex_init(&fp->lock, NULL) ? -1 : 0;
+}
+
+struct frame_ref *frame_pool_wrap(struct frame_pool *fp,
+				  const struct v4lcap_frame *frame)
+{
+	struct frame_ref *r;
+
+	if (frame->buf.index >= VIDEO_MAX_FRAME)
+		return NULL;
+	r = &fp->ref[frame->buf.index];
+	if (__atomic_load_n(&r->refs, __ATOMIC_ACQUIRE)) {
+		fprintf(stderr, "buffer %u is still held\n", frame->buf.index);
+		return NULL;
+	}
+
+	r->frame = *frame;
+	r->fmt = &fp->cap->fmt;
+	r->pool = fp;
+	r->t_wrap = now_us();
+	__atomic_store_n(&r->refs, 1, __ATOMIC_RELEASE);
+
+	pthread_mutex_lock(&fp->lock);
+	if (++fp->out > fp->max_out)
+		fp->max_out = fp->out;
+	pthread_mutex_unlock(&fp->lock);
+	return r;
+}
+
+int frame_ref_put(struct frame_ref *r)
+{
+	struct frame_pool *fp = r->pool;
+	int ret;
+
+	if (__atomic_sub_fetch(&r->refs, 1, __ATOMIC_ACQ_REL))
+		return 0;
+
+	/* the fd is shared by all threads, and so is cap->queued */
+	pthread_mutex_lock(&fp->lock);
+	latency_add(&fp->hold, now_us() - r->t_wrap);
+	fp->out--;
+	ret = v4lcap_requeue(fp->cap, &r->frame);
+	pthread_mutex_unlock(&fp->lock);
+	return ret;
+}
+
+void frame_pool_release(struct frame_pool *fp)
+{
+	pthread_mutex_destroy(&fp->lock);
+}
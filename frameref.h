@@ -0,0 +1,73 @@
+/*
+ *  Reference-counted frame handles
+ *
+ *  A dequeued buffer wrapped with its metadata (sequence, timestamp in
+ *  frame.buf, the negotiated format) so that several consumers, say the
+ *  display, a recorder and an analysis thread, can each keep it as long
+ *  as they need without copying it. Every consumer takes a reference
+ *  and drops it when done; the last one to drop it gives the buffer
+ *  back to the driver. Handles may be dropped from any thread.
+ *
+ *  A buffer held by consumers is a buffer the driver cannot fill, so
+ *  the pool keeps the distribution of hold times, from wrapping to the
+ *  requeue: if it approaches the frame interval times the number of
+ *  buffers, frames are about to be dropped.
+ *
+ *  With IO_METHOD_READ there is only one buffer, which the next read()
+ *  refills: a frame must be released before the next one is wrapped.
+ */
+
+#ifndef FRAMEREF_H
+#define FRAMEREF_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "v4lcapture.h"
+#include "latency.h"
+
+struct frame_pool;
+
+struct frame_ref {
+	struct v4lcap_frame		frame;	/* start, bytesused, buf */
+	const struct v4l2_format	*fmt;
+	struct frame_pool		*pool;
+	int				refs;
+	uint64_t			t_wrap;	/* us, CLOCK_MONOTONIC */
+};
+
+struct frame_pool {
+	struct v4lcap		*cap;
+	struct frame_ref	ref[VIDEO_MAX_FRAME];	/* by buffer index */
+	pthread_mutex_t		lock;			/* requeue, stats */
+	struct latency		hold;			/* wrap to requeue */
+	unsigned int		out;			/* handles alive */
+	unsigned int		max_out;
+};
+
+int frame_pool_init(struct frame_pool *fp, struct v4lcap *cap);
+
+/*
+ * Wrap a frame just dequeued from fp->cap, with one reference for the
+ * caller. NULL if its buffer is still held (read() io).
+ */
+struct frame_ref *frame_pool_wrap(struct frame_pool *fp,
+				  const struct v4lcap_frame *frame);
+
+/* another reference for another consumer */
+static inline struct frame_ref *frame_ref_get(struct frame_ref *r)
+{
+	__atomic_add_fetch(&r->refs, 1, __ATOMIC_RELAXED);
+	return r;
+}
+
+/*
+ * Drop a reference; the last one requeues the buffer. Returns -1 if
+ * that requeue failed.
+ */
+int frame_ref_put(struct frame_ref *r);
+
+/* After all handles are dropped. */
+void frame_pool_release(struct frame_pool *fp);
+
+#endif /* FRAMEREF_H */
@@ -0,0 +1,128 @@
+/*
+ *  Timestamp-aligned frame sets from several cameras
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <string.h>
+
+#include "frameset.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+static uint64_t frame_us(const struct v4lcap_frame *f)
+{
+	return (uint64_t)f->buf.timestamp.tv_sec * 1000000
+		+ f->buf.timestamp.tv_usec;
+}
+
+/* remove the oldest held frame of dev, into *out if not NULL */
+static void pop(struct frameset *fs, unsigned int dev, struct v4lcap_frame *out)
+{
+	if (out)
+		*out = fs->held[dev][0];
+	memmove(&fs->held[dev][0], &fs->held[dev][1],
+		(FRAMESET_DEPTH - 1) * sizeof(fs->held[dev][0]));
+	fs->count[dev]--;
+}
+
+static int drop(struct frameset *fs, unsigned int dev)
+{
+	struct v4lcap_frame f;
+
+	pop(fs, dev, &f);
+	fs->dropped[dev]++;
+	return v4lcap_requeue(fs->cap[dev], &f);
+}
+
+void frameset_init(struct frameset *fs, struct v4lcap **caps, unsigned int n,
+		   uint64_t tolerance)
+{
+	unsigned int i;
+
+	CLEAR(*fs);
+	fs->n = n < FRAMESET_MAX ? n : FRAMESET_MAX;
+	for (i = 0; i < fs->n; i++)
+		fs->cap[i] = caps[i];
+	fs->tolerance = tolerance;
+}
+
+int frameset_add(struct frameset *fs, unsigned int dev,
+		 const struct v4lcap_frame *frame)
+{
+	unsigned int i, oldest;
+	uint64_t t, tmin, tmax;
+
+	/* keep the device streaming: make room by dropping its oldest */
+	if (fs->count[dev] == FRAMESET_DEPTH && drop(fs, dev))
+		return -1;
+	fs->held[dev][fs->count[dev]++] = *frame;
+
+	for (;;) {
+		for (i = 0; i < fs->n; i++)
+			if (!fs->count[i])
+				return 0;
+
+		oldest = 0;
+		tmin = tmax = frame_us(&fs->held[0][0]);
+		for (i = 1; i < fs->n; i++) {
+			t = frame_us(&fs->held[i][0]);
+			if (t < tmin) {
+				tmin = t;
+				oldest = i;
+			}
+			if (t > tmax)
+				tmax = t;
+		}
+
+		if (tmax - tmin <= fs->tolerance)
+			break;
+
+		/*
+		Every other device is already past the oldest frame, so
+		nothing that arrives later can match it.
+		*/
+		if (drop(fs, oldest))
+			return -1;
+	}
+
+	for (i = 0; i < fs->n; i++)
+		pop(fs, i, &fs->set[i]);
+	fs->set_ready = 1;
+	fs->skew = tmax - tmin;
+	fs->sets++;
+	fs->skew_sum += fs->skew;
+	if (fs->skew > fs->skew_max)
+		fs->skew_max = fs->skew;
+	return 1;
+}
+
+int frameset_release(struct frameset *fs)
+{
+	unsigned int i;
+	int ret = 0;
+
+	if (!fs->set_ready)
+		return 0;
+	for (i = 0; i < fs->n; i++)
+		if (v4lcap_requeue(fs->cap[i], &fs->set[i]))
+			ret = -1;
+	fs->set_ready = 0;
+	return ret;
+}
+
+int frameset_flush(struct frameset *fs)
+{
+	unsigned int i;
+	int ret = frameset_release(fs);
+
+	for (i = 0; i < fs->n; i++)
+		while (fs->count[i]) {
+			struct v4lcap_frame f;
+
+			pop(fs, i, &f);
+			if (v4lcap_requeue(fs->cap[i], &f))
+				ret = -1;
+		}
+	return ret;
+}
@@ -0,0 +1,59 @@
+/*
+ *  Timestamp-aligned frame sets from several cameras
+ *
+ *  Frames dequeued from N devices are held back until every device has
+ *  one, then the oldest frames are matched by their driver timestamps.
+ *  If they lie within the tolerance they form a set, otherwise the
+ *  oldest frame has no partner any more and goes back to its driver.
+ *  A device never has more than FRAMESET_DEPTH frames held, so a
+ *  camera that stops delivering does not starve the others.
+ *
+ *  The timestamps are only comparable across devices if the drivers use
+ *  CLOCK_MONOTONIC (V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC).
+ */
+
+#ifndef FRAMESET_H
+#define FRAMESET_H
+
+#include <stdint.h>
+
+#include "v4lcapture.h"
+
+#define FRAMESET_MAX	8	/* devices */
+#define FRAMESET_DEPTH	2	/* frames held per device */
+
+struct frameset {
+	unsigned int		n;
+	struct v4lcap		*cap[FRAMESET_MAX];
+	struct v4lcap_frame	held[FRAMESET_MAX][FRAMESET_DEPTH];
+	unsigned int		count[FRAMESET_MAX];
+	uint64_t		tolerance;	/* us */
+
+	/* the complete set, valid from frameset_add() == 1 to release */
+	struct v4lcap_frame	set[FRAMESET_MAX];
+	int			set_ready;
+	uint64_t		skew;		/* us, newest - oldest in set */
+
+	unsigned long		sets;
+	unsigned long		dropped[FRAMESET_MAX];
+	uint64_t		skew_max;
+	double			skew_sum;
+};
+
+void frameset_init(struct frameset *fs, struct v4lcap **caps, unsigned int n,
+		   uint64_t tolerance);
+
+/*
+ * Hand a dequeued frame of device dev to the matcher. Returns 1 if a
+ * set is complete in fs->set[], 0 if not, -1 if a requeue failed.
+ */
+int frameset_add(struct frameset *fs, unsigned int dev,
+		 const struct v4lcap_frame *frame);
+
+/* Give the frames of the current set back to their drivers. */
+int frameset_release(struct frameset *fs);
+
+/* Give all held frames back, e.g. before stopping. */
+int frameset_flush(struct frameset *fs);
+
+#endif /* FRAMESET_H */
@@ -0,0 +1,74 @@
+/*
+ *  Example subscriber for "demo -P"
+ *
+ *  This program can be used and distributed without restrictions.
+ *
+ *  usage: framesub socket [delay ms]
+ *  The frames are read in place from the shared ring. A delay simulates
+ *  a slow consumer: the publisher carries on and this subscriber just
+ *  sees gaps and overwritten frames.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "frame_pub.h"
+
+int main(int argc, char **argv)
+{
+	struct frame_sub fs;
+	struct frame_pub_msg msg;
+	const struct frame_ring_slot *slot;
+	const unsigned char *p;
+	unsigned long frames = 0, torn = 0, missed = 0, sum;
+	uint32_t last_seq = 0, i, size, sequence;
+	int delay;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s socket [delay ms]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	delay = argc > 2 ? atoi(argv[2]) : 0;
+
+	if (frame_sub_connect(&fs, argv[1]))
+		exit(EXIT_FAILURE);
+
+	printf("%ux%u %.4s, %u slots\n", fs.ring->width, fs.ring->height,
+		(const char *)&fs.ring->pixelformat, fs.ring->nslots);
+
+	while (!frame_sub_wait(&fs, &msg)) {
+		slot = &fs.ring->slot[msg.slot];
+		p = frame_sub_data(&fs, msg.slot);
+		/*
+		Like the data, these only count if the generation still
+		matches afterwards, so take them once, before the check.
+		A torn size must not take the loop out of the slot.
+		*/
+		size = __atomic_load_n(&slot->size, __ATOMIC_RELAXED);
+		sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+		if (size > fs.ring->slot_size)
+			size = fs.ring->slot_size;
+
+		/* stand-in for real work: touch every 64th byte in place */
+		for (sum = 0, i = 0; i < size; i += 64)
+			sum += p[i];
+		if (delay)
+			usleep(delay * 1000);
+
+		if (!frame_sub_valid(&fs, &msg)) {
+			torn++;
+			continue;
+		}
+		if (frames && sequence - last_seq > 1)
+			missed += sequence - last_seq - 1;
+		last_seq = sequence;
+		if (!(++frames % 30))
+			printf("seq %u: frames %lu missed %lu torn %lu (sum %lu)\n",
+				last_seq, frames, missed, torn, sum);
+		fflush(stdout);
+	}
+
+	frame_sub_close(&fs);
+	return 0;
+}
@@ -0,0 +1,362 @@
+/*
+ *  Cost of the V4L2 I/O methods
+ *
+ *  This program can be used and distributed without restrictions.
+ *
+ *  Grabs the same number of frames from one device with read(), mmap,
+ *  userptr and dmabuf buffers in turn and prints one table: CPU time,
+ *  system calls and page faults per frame, the DQBUF latency (driver
+ *  timestamp to dequeue) and the frame rate achieved. Every cache line
+ *  of each frame is read, as a consumer would, so the cost of uncached
+ *  or freshly faulted buffers shows up in the CPU time. Without a camera
+ *  the vivid driver gives a device that supports all four:
+ *	modprobe vivid && iobench -d /dev/video0 -c 300
+ *
+ *  System calls are counted with the raw_syscalls:sys_enter tracepoint
+ *  when perf events may use it, otherwise iobench counts the calls its
+ *  loop makes (marked ~), which misses retries inside the library.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <getopt.h>             /* getopt_long() */
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/syscall.h>
+
+#include <linux/perf_event.h>
+
+#include "v4lcapture.h"
+#include "latency.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+#define WARMUP	8	/* frames before the measurement, not counted */
+#define LINE	64	/* bytes, stride of the consumer's reads */
+
+static const struct {
+	enum io_method	io;
+	const char	*name;
+} methods[] = {
+	{ IO_METHOD_READ,    "read"    },
+	{ IO_METHOD_MMAP,    "mmap"    },
+	{ IO_METHOD_USERPTR, "userptr" },
+	{ IO_METHOD_DMABUF,  "dmabuf"  },
+};
+
+#define N_METHODS	(sizeof(methods) / sizeof(methods[0]))
+
+struct result {
+	int		ok;
+	unsigned long	frames;
+	double		cpu_us;		/* user + system, per frame */
+	double		syscalls;	/* per frame */
+	int		counted;	/* syscalls from our own loop */
+	long		setup_flt;	/* minor + major, open to first frame */
+	double		flt;		/* per frame */
+	long		majflt;
+	struct latency	lat;
+	double		fps;
+};
+
+static char            *dev_name;
+static int              force_format;
+static int              frame_count = 300;
+static volatile unsigned char sink;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t tv_us(const struct timeval *tv)
+{
+	return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/* system calls of this thread, or -1 if the tracepoint is not usable */
+static int syscall_counter(void)
+{
+	static const char *paths[] = {
+		"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+		"/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+	};
+	struct perf_event_attr attr;
+	unsigned long long id = 0;
+	unsigned int i;
+	FILE *f;
+	int n = 0;
+
+	for (i = 0; i < sizeof(paths) / sizeof(paths[0]) && n != 1; i++) {
+		f = fopen(paths[i], "r");
+		if (!f)
+			continue;
+		n = fscanf(f, "%llu", &id);
+		fclose(f);
+	}
+	if (n != 1)
+		return -1;
+
+	CLEAR(attr);
+	attr.type = PERF_TYPE_TRACEPOINT;
+	attr.size = sizeof(attr);
+	attr.config = id;
+	attr.disabled = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void touch(const unsigned char *p, size_t size)
+{
+	unsigned char s = 0;
+	size_t i;
+
+	for (i = 0; i < size; i += LINE)
+		s += p[i];
+	sink = s;
+}
+
+/*
+ * Grab n frames, select() for each one like the demos do. Returns the
+ * number of system calls the loop made itself, or -1 on error.
+ */
+static long grab(struct v4lcap *cap, int n, struct latency *l)
+{
+	struct v4lcap_frame frame;
+	long calls = 0;
+	int r;
+
+	while (n > 0) {
+		fd_set fds;
+		struct timeval tv;
+
+		FD_ZERO(&fds);
+		FD_SET(cap->fd, &fds);
+
+		/* Timeout. */
+		tv.tv_sec = 2;
+		tv.tv_usec = 0;
+
+		calls++;
+		r = select(cap->fd + 1, &fds, NULL, NULL, &tv);
+		if (-1 == r) {
+			if (EINTR == errno)
+				continue;
+			fprintf(stderr, "select error %d, %s\n",
+				errno, strerror(errno));
+			return -1;
+		}
+		if (0 == r) {
+			fprintf(stderr, "select timeout\n");
+			return -1;
+		}
+
+		calls++;
+		r = v4lcap_dequeue(cap, &frame);
+		if (-1 == r)
+			return -1;
+		if (0 == r)
+			continue;
+
+		touch(frame.start, frame.bytesused);
+		if (l && IO_METHOD_READ != cap->io)
+			latency_add_since(l, &frame.buf);
+
+		if (v4lcap_requeue(cap, &frame))
+			return -1;
+		/* QBUF, and a DMA_BUF_IOCTL_SYNC on either side of the access */
+		if (IO_METHOD_READ != cap->io)
+			calls += IO_METHOD_DMABUF == cap->io ? 3 : 1;
+		n--;
+	}
+	return calls;
+}
+
+static void run(enum io_method io, const char *name, struct result *res)
+{
+	struct v4l2_pix_format forced;
+	struct v4lcap cap;
+	struct rusage ru0, ru1;
+	uint64_t t;
+	long long sc = 0;
+	long calls;
+	int counter;
+
+	CLEAR(*res);
+	latency_init(&res->lat, name);
+	CLEAR(forced);
+	forced.width       = 640;
+	forced.height      = 480;
+	forced.pixelformat = V4L2_PIX_FMT_YUYV;
+	forced.field       = V4L2_FIELD_INTERLACED;
+
+	CLEAR(cap);
+	getrusage(RUSAGE_SELF, &ru0);
+	if (v4lcap_open(&cap, dev_name, io) ||
+	    v4lcap_set_format(&cap, force_format ? &forced : NULL) ||
+	    v4lcap_init_buffers(&cap) ||
+	    v4lcap_start(&cap) ||
+	    -1 == grab(&cap, WARMUP, NULL)) {
+		v4lcap_close(&cap);
+		return;
+	}
+
+	counter = syscall_counter();
+	getrusage(RUSAGE_SELF, &ru1);
+	res->setup_flt = ru1.ru_minflt - ru0.ru_minflt
+		       + ru1.ru_majflt - ru0.ru_majflt;
+	ru0 = ru1;
+
+	if (-1 != counter) {
+		ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+		ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	t = now_us();
+	calls = grab(&cap, frame_count, &res->lat);
+	t = now_us() - t;
+	if (-1 != counter) {
+		ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+		if (sizeof(sc) != read(counter, &sc, sizeof(sc)))
+			sc = -1;
+		close(counter);
+	}
+	getrusage(RUSAGE_SELF, &ru1);
+
+	v4lcap_stop(&cap);
+	v4lcap_close(&cap);
+	if (-1 == calls)
+		return;
+
+	res->ok = 1;
+	res->frames = frame_count;
+	res->cpu_us = (double)(tv_us(&ru1.ru_utime) - tv_us(&ru0.ru_utime)
+			       + tv_us(&ru1.ru_stime) - tv_us(&ru0.ru_stime))
+		      / frame_count;
+	res->counted = -1 == counter || -1 == sc;
+	res->syscalls = (double)(res->counted ? calls : sc) / frame_count;
+	res->flt = (double)(ru1.ru_minflt - ru0.ru_minflt
+			    + ru1.ru_majflt - ru0.ru_majflt) / frame_count;
+	res->majflt = ru1.ru_majflt - ru0.ru_majflt;
+	res->fps = t ? frame_count * 1e6 / t : 0;
+}
+
+static void report(const struct result *res)
+{
+	char sc[16];
+	unsigned int i;
+
+	printf("%s, %d frames per method, %d warm-up\n\n",
+	       dev_name, frame_count, WARMUP);
+	printf("%-8s %8s %9s %11s %8s %7s %9s %13s\n", "method", "fps",
+	       "cpu us/f", "syscalls/f", "flt/f", "majflt", "setup flt",
+	       "dq p50/p99 us");
+	for (i = 0; i < N_METHODS; i++) {
+		const struct result *r = &res[i];
+
+		if (!r->ok) {
+			printf("%-8s %8s\n", methods[i].name, "n/a");
+			continue;
+		}
+		snprintf(sc, sizeof(sc), "%s%.1f", r->counted ? "~" : "",
+			 r->syscalls);
+		printf("%-8s %8.1f %9.1f %11s %8.2f %7ld %9ld ",
+		       methods[i].name, r->fps, r->cpu_us, sc, r->flt,
+		       r->majflt, r->setup_flt);
+		if (r->lat.n)
+			printf("%6llu/%-6llu\n",
+			       (unsigned long long)latency_percentile(&r->lat, 0.5),
+			       (unsigned long long)latency_percentile(&r->lat, 0.99));
+		else
+			printf("%13s\n", "n/a");
+	}
+}
+
+static void usage(FILE *fp, int argc, char **argv)
+{
+	fprintf(fp,
+		 "Usage: %s [options]\n\n"
+		 "Options:\n"
+		 "-d | --device name   Video device name [%s]\n"
+		 "-h | --help          Print this message\n"
+		 "-f | --format        Force format to 640x480 YUYV\n"
+		 "-c | --count         Frames per method [%i]\n"
+		 "",
+		 argv[0], dev_name, frame_count);
+}
+
+static const char short_options[] = "d:hfc:";
+
+static const struct option
+long_options[] = {
+	{ "device", required_argument, NULL, 'd' },
+	{ "help",   no_argument,       NULL, 'h' },
+	{ "format", no_argument,       NULL, 'f' },
+	{ "count",  required_argument, NULL, 'c' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	static struct result res[N_METHODS];
+	unsigned int i;
+
+	dev_name = "/dev/video0";
+
+	for (;;) {
+		int idx;
+		int c;
+
+		c = getopt_long(argc, argv,
+				short_options, long_options, &idx);
+
+		if (-1 == c)
+			break;
+
+		switch (c) {
+		case 0: /* getopt_long() flag */
+			break;
+
+		case 'd':
+			dev_name = optarg;
+			break;
+
+		case 'h':
+			usage(stdout, argc, argv);
+			exit(EXIT_SUCCESS);
+
+		case 'f':
+			force_format++;
+			break;
+
+		case 'c':
+			frame_count = atoi(optarg);
+			break;
+
+		default:
+			usage(stderr, argc, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (frame_count <= 0) {
+		usage(stderr, argc, argv);
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < N_METHODS; i++) {
+		fprintf(stderr, "%s...\n", methods[i].name);
+		run(methods[i].io, methods[i].name, &res[i]);
+	}
+	report(res);
+	return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ *  Latency distribution
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "latency.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+void latency_init(struct latency *l, const char *name)
+{
+	CLEAR(*l);
+	l->name = name;
+	l->bin_us = LATENCY_BIN_US;
+}
+
+void latency_init_range(struct latency *l, const char *name,
+			uint64_t max_us)
+{
+	latency_init(l, name);
+	if (max_us > LATENCY_MAX_US)
+		l->bin_us = (max_us + LATENCY_BINS - 2) / (LATENCY_BINS - 1);
+}
+
+void latency_add(struct latency *l, uint64_t us)
+{
+	uint64_t bin = us / l->bin_us;
+
+	if (bin >= LATENCY_BINS)
+		bin = LATENCY_BINS - 1;
+	l->bins[bin]++;
+	if (!l->n || us < l->min)
+		l->min = us;
+	if (us > l->max)
+		l->max = us;
+	l->sum += us;
+	l->n++;
+}
+
+void latency_add_since(struct latency *l, const struct v4l2_buffer *buf)
+{
+	struct timespec ts;
+	int64_t t, d;
+
+	if (!(buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC))
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	d = t - ((int64_t)buf->timestamp.tv_sec * 1000000
+		 + buf->timestamp.tv_usec);
+	latency_add(l, d > 0 ? d : 0);
+}
+
+uint64_t latency_percentile(const struct latency *l, double p)
+{
+	unsigned long want, seen = 0;
+	unsigned int i;
+
+	if (!l->n)
+		return 0;
+	want = (unsigned long)(p * l->n);
+	if (want >= l->n)
+		want = l->n - 1;
+	for (i = 0; i < LATENCY_BINS; i++) {
+		seen += l->bins[i];
+		if (seen > want)
+			break;
+	}
+	if (i == LATENCY_BINS - 1 || (uint64_t)(i + 1) * l->bin_us > l->max)
+		return l->max;
+	return (uint64_t)(i + 1) * l->bin_us;
+}
+
+void latency_report_header(FILE *f)
+{
+	fprintf(f, "%-12s %8s %8s %8s %8s %8s %8s %8s\n", "latency us",
+		"n", "min", "mean", "p50", "p99", "p99.9", "max");
+}
+
+void latency_report(const struct latency *l, FILE *f)
+{
+	fprintf(f, "%-12s %8lu %8llu %8.0f %8llu %8llu %8llu %8llu\n",
+		l->name, l->n, (unsigned long long)l->min,
+		l->n ? (double)l->sum / l->n : 0.0,
+		(unsigned long long)latency_percentile(l, 0.5),
+		(unsigned long long)latency_percentile(l, 0.99),
+		(unsigned long long)latency_percentile(l, 0.999),
+		(unsigned long long)l->max);
+}
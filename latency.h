@@ -0,0 +1,54 @@
+/*
+ *  Latency distribution
+ *
+ *  Fixed 10us bins up to LATENCY_MAX_US, so recording a sample is an
+ *  increment and needs no allocation in the capture loop. Latencies of
+ *  whole frame periods (display, buffers held) are coarser: the same
+ *  number of bins spread over a longer range.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <linux/videodev2.h>
+
+#define LATENCY_BIN_US	10
+#define LATENCY_MAX_US	50000
+#define LATENCY_BINS	(LATENCY_MAX_US / LATENCY_BIN_US + 1)	/* + overflow */
+#define LATENCY_LONG_US	5000000	/* range for frame-period latencies */
+
+struct latency {
+	const char	*name;
+	unsigned int	bin_us;
+	unsigned long	n;
+	uint64_t	sum;
+	uint64_t	min, max;
+	unsigned int	bins[LATENCY_BINS];
+};
+
+/* bins of LATENCY_BIN_US */
+void latency_init(struct latency *l, const char *name);
+
+/* bins wide enough that max_us is the start of the overflow bin */
+void latency_init_range(struct latency *l, const char *name,
+			uint64_t max_us);
+
+void latency_add(struct latency *l, uint64_t us);
+
+/*
+ * Record driver timestamp to now for a dequeued buffer. Buffers without
+ * a monotonic timestamp are skipped.
+ */
+void latency_add_since(struct latency *l, const struct v4l2_buffer *buf);
+
+/* upper bound of the bin holding the p-th fraction, e.g. p = 0.99 */
+uint64_t latency_percentile(const struct latency *l, double p);
+
+void latency_report_header(FILE *f);
+
+void latency_report(const struct latency *l, FILE *f);
+
+#endif /* LATENCY_H */
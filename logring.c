@@ -0,0 +1,379 @@
+/*
+ *  Lock-free binary log ring
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "logring.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+#define MASK		(LOGR_RECORDS - 1)
+#define OUT_SIZE	8192	/* formatted bytes per write() */
+
+int logr_level = LOGR_INFO;
+
+static struct logr_record ring[LOGR_RECORDS];
+static uint64_t head;		/* records claimed */
+static uint64_t tail;		/* records written out, drain side only */
+static unsigned long lost;
+static int running;
+static int quit;
+static int out_fd = 2;
+static unsigned int period;
+static pthread_t drain_thread;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char level_tag[] = "EWID";
+
+static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGABRT };
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Walk the conversions of fmt and take each argument as the type it
+ * was promoted to, so the drain can hand it back to printf unchanged.
+ */
+static void take_args(struct logr_record *r, const char *fmt, va_list ap)
+{
+	size_t text = 0, n, max;
+	const char *f, *s;
+	int longs, prec;
+
+	r->nargs = 0;
+	for (f = fmt; *f; f++) {
+		if ('%' != *f)
+			continue;
+		if ('%' == *++f)
+			continue;
+		longs = 0;
+		prec = -1;
+		for (; *f; f++) {
+			if ('*' == *f) {
+				/* a width or precision argument */
+				if (r->nargs < LOGR_ARGS)
+					r->arg[r->nargs++].u = va_arg(ap, int);
+				if ('.' == f[-1])
+					prec = r->arg[r->nargs - 1].u;
+			} else if ('.' == *f && f[1] >= '0' && f[1] <= '9') {
+				/* "%.4s" may point at a fourcc, no NUL */
+				prec = strtol(f + 1, NULL, 10);
+			} else if ('l' == *f || 'j' == *f || 'z' == *f ||
+				   't' == *f) {
+				longs += 'l' == *f ? 1 : 2;
+			} else if (strchr("ouxX", *f)) {
+				/* zero-extended, bit 31 is common in flags */
+				if (r->nargs == LOGR_ARGS)
+					return;
+				if (longs > 1)
+					r->arg[r->nargs++].u =
+						va_arg(ap, unsigned long long);
+				else if (longs)
+					r->arg[r->nargs++].u =
+						va_arg(ap, unsigned long);
+				else
+					r->arg[r->nargs++].u =
+						va_arg(ap, unsigned int);
+				break;
+			} else if (strchr("dic", *f)) {
+				if (r->nargs == LOGR_ARGS)
+					return;
+				if (longs > 1)
+					r->arg[r->nargs++].u = va_arg(ap, long long);
+				else if (longs)
+					r->arg[r->nargs++].u = va_arg(ap, long);
+				else
+					r->arg[r->nargs++].u = va_arg(ap, int);
+				break;
+			} else if (strchr("feEgGaA", *f)) {
+				if (r->nargs == LOGR_ARGS)
+					return;
+				r->arg[r->nargs++].d = va_arg(ap, double);
+				break;
+			} else if ('s' == *f) {
+				if (r->nargs == LOGR_ARGS)
+					return;
+				s = va_arg(ap, const char *);
+				if (!s)
+					s = "(null)";
+				max = LOGR_TEXT - 1 - text;
+				if (prec >= 0 && (size_t)prec < max)
+					max = prec;
+				n = strnlen(s, max);
+				memcpy(r->text + text, s, n);
+				r->text[text + n] = 0;
+				r->arg[r->nargs++].u = text;
+				text += n + (text + n < LOGR_TEXT - 1);
+				break;
+			} else if ('p' == *f) {
+				if (r->nargs == LOGR_ARGS)
+					return;
+				r->arg[r->nargs++].p = va_arg(ap, void *);
+				break;
+			} else if (!strchr("#0- +'.123456789hLqZ", *f)) {
+				break;	/* unknown, no argument */
+			}
+		}
+		if (!*f)
+			return;
+	}
+}
+
+/* printf again, one conversion at a time, from the stored arguments */
+static int format(char *out, size_t size, const struct logr_record *r)
+{
+	const char *f = r->fmt, *start;
+	char spec[32], *sp;
+	unsigned int a = 0;
+	size_t len = 0;
+	int n;
+
+	n = snprintf(out, size, "%llu.%06llu %c ",
+		     (unsigned long long)(r->t_ns / 1000000000),
+		     (unsigned long long)(r->t_ns % 1000000000 / 1000),
+		     level_tag[r->level & 3]);
+	len = n;
+
+	while (*f && len < size - 1) {
+		if ('%' != *f || '%' == f[1]) {
+			out[len++] = *f;
+			f += '%' == *f ? 2 : 1;
+			continue;
+		}
+		/* one conversion, without length modifiers */
+		start = f++;
+		sp = spec;
+		*sp++ = '%';
+		while (*f && !strchr("diouxXcfeEgGaAsp", *f)) {
+			if ('*' == *f && a < r->nargs)
+				/* the width or precision that was passed */
+				sp += snprintf(sp, spec + sizeof(spec) - 4 - sp,
+					       "%d", (int)r->arg[a++].u);
+			else if (!strchr("*hljztLqZ", *f) &&
+				 sp < spec + sizeof(spec) - 4)
+				*sp++ = *f;
+			if (sp > spec + sizeof(spec) - 4)
+				sp = spec + sizeof(spec) - 4;
+			f++;
+		}
+		if (!*f)
+			break;
+		if (strchr("diouxX", *f))
+			*sp++ = 'l', *sp++ = 'l';
+		*sp++ = *f;
+		*sp = 0;
+
+		if (a >= r->nargs) {
+			n = snprintf(out + len, size - len, "%.*s",
+				     (int)(f + 1 - start), start);
+		} else if ('c' == *f) {
+			n = snprintf(out + len, size - len, spec,
+				     (int)r->arg[a++].u);
+		} else if (strchr("di", *f)) {
+			n = snprintf(out + len, size - len, spec,
+				     (long long)r->arg[a++].u);
+		} else if (strchr("ouxX", *f)) {
+			n = snprintf(out + len, size - len, spec,
+				     (unsigned long long)r->arg[a++].u);
+		} else if ('s' == *f) {
+			n = snprintf(out + len, size - len, spec,
+				     r->text + r->arg[a++].u);
+		} else if ('p' == *f) {
+			n = snprintf(out + len, size - len, spec, r->arg[a++].p);
+		} else {
+			n = snprintf(out + len, size - len, spec, r->arg[a++].d);
+		}
+		len += n > 0 ? (size_t)n : 0;
+		if (len >= size)
+			len = size - 1;
+		f++;
+	}
+	out[len] = 0;
+	return len;
+}
+
+static void write_all(int fd, const char *p, size_t n)
+{
+	ssize_t r;
+
+	while (n) {
+		r = write(fd, p, n);
+		if (r <= 0)
+			return;
+		p += r;
+		n -= r;
+	}
+}
+
+/*
+ * Format into out and write out what is complete from *tailp on, and
+ * returns records written.
+ */
+static unsigned int drain(char *out, uint64_t *tailp)
+{
+	struct logr_record r;
+	uint64_t pos = *tailp;
+	uint64_t h, seq;
+	size_t len = 0;
+	unsigned int done = 0;
+
+	h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	if (h - pos > LOGR_RECORDS) {
+		lost += h - pos - LOGR_RECORDS;
+		pos = h - LOGR_RECORDS;
+	}
+
+	while (pos < h) {
+		struct logr_record *slot = &ring[pos & MASK];
+
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		if (seq < pos + 1)
+			break;		/* still being written */
+		r = *slot;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (seq > pos + 1 ||
+		    __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+			/* overwritten under us by a writer a lap ahead */
+			lost++;
+			pos++;
+			continue;
+		}
+
+		if (len > OUT_SIZE - 512) {
+			write_all(out_fd, out, len);
+			len = 0;
+		}
+		len += format(out + len, OUT_SIZE - len, &r);
+		pos++;
+		done++;
+	}
+	if (len)
+		write_all(out_fd, out, len);
+	*tailp = pos;
+	return done;
+}
+
+static unsigned int drain_ring(void)
+{
+	static char out[OUT_SIZE];
+
+	return drain(out, &tail);
+}
+
+void logring_write(int level, const char *fmt, ...)
+{
+	struct logr_record *r;
+	va_list ap;
+	uint64_t i;
+
+	va_start(ap, fmt);
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+		vfprintf(stderr, fmt, ap);
+		va_end(ap);
+		return;
+	}
+
+	i = __atomic_fetch_add(&head, 1, __ATOMIC_ACQ_REL);
+	r = &ring[i & MASK];
+	__atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	r->t_ns = now_ns();
+	r->fmt = fmt;
+	r->level = level;
+	take_args(r, fmt, ap);
+	va_end(ap);
+	__atomic_store_n(&r->seq, i + 1, __ATOMIC_RELEASE);
+}
+
+static void *drain_main(void *arg)
+{
+	struct timespec ts;
+
+	(void)arg;
+	ts.tv_sec = period / 1000;
+	ts.tv_nsec = (period % 1000) * 1000000L;
+	while (!__atomic_load_n(&quit, __ATOMIC_ACQUIRE)) {
+		nanosleep(&ts, NULL);
+		pthread_mutex_lock(&drain_lock);
+		drain_ring();
+		pthread_mutex_unlock(&drain_lock);
+	}
+	return NULL;
+}
+
+/* dump what the ring holds, then die of the signal as before */
+static void crash(int sig)
+{
+	static char out[OUT_SIZE];
+	uint64_t t;
+
+	/*
+	The drain thread may hold the lock forever now, don't wait. If it
+	does, dump from its position on with a buffer and tail of our own;
+	records it is writing out may then come twice.
+	*/
+	if (!pthread_mutex_trylock(&drain_lock)) {
+		drain_ring();
+	} else {
+		t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+		drain(out, &t);
+	}
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+int logring_start(int fd, unsigned int period_ms)
+{
+	struct sigaction sa;
+	unsigned int i;
+
+	out_fd = fd;
+	period = period_ms ? period_ms : 100;
+	quit = 0;
+	if (pthread_create(&drain_thread, NULL, drain_main, NULL)) {
+		fprintf(stderr, "log ring: no drain thread, logging directly\n");
+		return -1;
+	}
+
+	CLEAR(sa);
+	sa.sa_handler = crash;
+	sa.sa_flags = SA_RESETHAND;
+	for (i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); i++)
+		sigaction(crash_signals[i], &sa, NULL);
+
+	__atomic_store_n(&running, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+void logring_stop(void)
+{
+	if (!__atomic_load_n(&running, __ATOMIC_ACQUIRE))
+		return;
+	__atomic_store_n(&quit, 1, __ATOMIC_RELEASE);
+	pthread_join(drain_thread, NULL);
+	__atomic_store_n(&running, 0, __ATOMIC_RELEASE);
+	/* writers that saw running just before */
+	drain_ring();
+	if (lost)
+		fprintf(stderr, "log ring: %lu records lost\n", lost);
+}
+
+unsigned long logring_lost(void)
+{
+	return lost;
+}
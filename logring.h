@@ -0,0 +1,88 @@
+/*
+ *  Lock-free binary log ring
+ *
+ *  A log call in the capture path stores the format string pointer, the
+ *  arguments in binary and a CLOCK_MONOTONIC timestamp into a fixed-size
+ *  record of a shared ring: one atomic increment to claim the record, no
+ *  lock, no formatting, no system call. A background thread formats the
+ *  records and writes them out in batches; whatever is left is written
+ *  when the ring is stopped, and on SIGSEGV, SIGBUS, SIGFPE and SIGABRT
+ *  the handler dumps the ring before the process dies.
+ *
+ *  Levels above LOGR_COMPILED_LEVEL are not compiled in at all, e.g.
+ *  -DLOGR_COMPILED_LEVEL=LOGR_INFO removes every logr_debug(); those
+ *  compiled in are filtered at run time by logr_level.
+ *
+ *  The format string must be a literal or otherwise outlive the ring.
+ *  %s arguments are copied into the record, up to LOGR_TEXT bytes for
+ *  all of them together. Writers that lap the drain thread overwrite
+ *  the oldest records, which are counted as lost.
+ *
+ *  Until logring_start() the calls format to stderr directly, so tools
+ *  that never start the ring log as before.
+ */
+
+#ifndef LOGRING_H
+#define LOGRING_H
+
+#include <stdint.h>
+
+#define LOGR_ERR	0
+#define LOGR_WARN	1
+#define LOGR_INFO	2
+#define LOGR_DEBUG	3
+
+#ifndef LOGR_COMPILED_LEVEL
+#define LOGR_COMPILED_LEVEL	LOGR_DEBUG
+#endif
+
+#define LOGR_RECORDS	4096	/* power of two */
+#define LOGR_ARGS	8
+#define LOGR_TEXT	64
+
+union logr_arg {
+	uint64_t	u;
+	double		d;
+	const void	*p;
+};
+
+struct logr_record {
+	uint64_t	seq;		/* index + 1 once complete, 0 meanwhile */
+	uint64_t	t_ns;
+	const char	*fmt;
+	uint32_t	level;
+	uint32_t	nargs;
+	union logr_arg	arg[LOGR_ARGS];	/* %s: offset into text */
+	char		text[LOGR_TEXT];
+};
+
+/* run-time filter, defaults to LOGR_INFO */
+extern int logr_level;
+
+#define logr(level, fmt, arg...) do {					\
+	if ((level) <= LOGR_COMPILED_LEVEL && (level) <= logr_level)	\
+		logring_write(level, fmt, ##arg);			\
+} while (0)
+
+#define logr_err(fmt, arg...)	logr(LOGR_ERR, fmt, ##arg)
+#define logr_warn(fmt, arg...)	logr(LOGR_WARN, fmt, ##arg)
+#define logr_info(fmt, arg...)	logr(LOGR_INFO, fmt, ##arg)
+#define logr_debug(fmt, arg...)	logr(LOGR_DEBUG, fmt, ##arg)
+
+void logring_write(int level, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/*
+ * Start the drain thread, writing to fd every period_ms, and install
+ * the crash handlers. Returns -1 if the thread cannot be started; the
+ * calls keep formatting directly then.
+ */
+int logring_start(int fd, unsigned int period_ms);
+
+/* Write out everything and stop the thread. */
+void logring_stop(void);
+
+/* records overwritten before they were written out */
+unsigned long logring_lost(void);
+
+#endif /* LOGRING_H */
@@ -0,0 +1,263 @@
+/*
+ *  Synchronized multi-camera capture
+ *
+ *  This program can be used and distributed without restrictions.
+ *
+ *  Captures from up to FRAMESET_MAX devices at once and groups the frames
+ *  into sets by driver timestamp, e.g. for stereo:
+ *	multicam -d /dev/video0 -d /dev/video1 -t 5
+ *
+ *  The report includes, per device, the time from driver timestamp to
+ *  DQBUF, i.e. how long a frame waited for the shared select() loop.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <getopt.h>             /* getopt_long() */
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/select.h>
+
+#include "v4lcapture.h"
+#include "frameset.h"
+#include "latency.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+static char            *dev_names[FRAMESET_MAX];
+static unsigned int     n_devs;
+static struct v4lcap    caps[FRAMESET_MAX];
+static struct frameset  sets;
+static struct latency   lat[FRAMESET_MAX];
+static int              force_format;
+static int              set_count = 100;
+static int              tolerance_ms = 5;
+static int              verbose;
+
+static void errno_exit(const char *s)
+{
+	fprintf(stderr, "%s error %d, %s\n", s, errno, strerror(errno));
+	exit(EXIT_FAILURE);
+}
+
+static void process_set(const struct frameset *fs)
+{
+	unsigned int i;
+
+	if (!verbose) {
+		fprintf(stderr, ".");
+		return;
+	}
+	fprintf(stderr, "set %lu skew %llu us:", fs->sets,
+		(unsigned long long)fs->skew);
+	for (i = 0; i < fs->n; i++)
+		fprintf(stderr, " %u", fs->set[i].buf.sequence);
+	fprintf(stderr, "\n");
+}
+
+static void mainloop(void)
+{
+	struct v4lcap_frame frame;
+	unsigned int i;
+	int count = set_count;
+	int warned[FRAMESET_MAX] = { 0 };
+
+	while (count > 0) {
+		fd_set fds;
+		struct timeval tv;
+		int r, nfds = 0;
+
+		FD_ZERO(&fds);
+		for (i = 0; i < n_devs; i++) {
+			FD_SET(caps[i].fd, &fds);
+			if (caps[i].fd > nfds)
+				nfds = caps[i].fd;
+		}
+
+		/* Timeout. */
+		tv.tv_sec = 2;
+		tv.tv_usec = 0;
+
+		r = select(nfds + 1, &fds, NULL, NULL, &tv);
+
+		if (-1 == r) {
+			if (EINTR == errno)
+				continue;
+			errno_exit("select");
+		}
+
+		if (0 == r) {
+			fprintf(stderr, "select timeout\n");
+			exit(EXIT_FAILURE);
+		}
+
+		for (i = 0; i < n_devs && count > 0; i++) {
+			if (!FD_ISSET(caps[i].fd, &fds))
+				continue;
+			r = v4lcap_dequeue(&caps[i], &frame);
+			if (-1 == r)
+				exit(EXIT_FAILURE);
+			if (0 == r)
+				continue;
+			latency_add_since(&lat[i], &frame.buf);
+			if (!(frame.buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+			    && !warned[i]++)
+				fprintf(stderr, "%s: timestamps are not monotonic, "
+					"sets may not match\n", caps[i].dev_name);
+
+			r = frameset_add(&sets, i, &frame);
+			if (-1 == r)
+				exit(EXIT_FAILURE);
+			if (1 == r) {
+				process_set(&sets);
+				if (frameset_release(&sets))
+					exit(EXIT_FAILURE);
+				count--;
+			}
+		}
+	}
+
+	if (frameset_flush(&sets))
+		exit(EXIT_FAILURE);
+}
+
+static void report(void)
+{
+	unsigned int i;
+
+	fprintf(stderr, "\n%lu sets, skew mean %.0f us, max %llu us\n",
+		sets.sets, sets.sets ? sets.skew_sum / sets.sets : 0.0,
+		(unsigned long long)sets.skew_max);
+	for (i = 0; i < n_devs; i++)
+		fprintf(stderr, "  %s: %lu frames without a set\n",
+			caps[i].dev_name, sets.dropped[i]);
+
+	latency_report_header(stderr);
+	for (i = 0; i < n_devs; i++)
+		if (lat[i].n)
+			latency_report(&lat[i], stderr);
+}
+
+static void usage(FILE *fp, int argc, char **argv)
+{
+	fprintf(fp,
+		 "Usage: %s [options]\n\n"
+		 "Options:\n"
+		 "-d | --device name   Video device name, repeat for each camera\n"
+		 "-h | --help          Print this message\n"
+		 "-f | --format        Force format to 640x480 YUYV\n"
+		 "-t | --tolerance ms  Largest timestamp skew within a set [%i]\n"
+		 "-c | --count         Number of sets to grab [%i]\n"
+		 "-v | --verbose       Print every set\n"
+		 "",
+		 argv[0], tolerance_ms, set_count);
+}
+
+static const char short_options[] = "d:hft:c:v";
+
+static const struct option
+long_options[] = {
+	{ "device",    required_argument, NULL, 'd' },
+	{ "help",      no_argument,       NULL, 'h' },
+	{ "format",    no_argument,       NULL, 'f' },
+	{ "tolerance", required_argument, NULL, 't' },
+	{ "count",     required_argument, NULL, 'c' },
+	{ "verbose",   no_argument,       NULL, 'v' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	struct v4l2_pix_format forced;
+	struct v4lcap *capp[FRAMESET_MAX];
+	unsigned int i;
+
+	for (;;) {
+		int idx;
+		int c;
+
+		c = getopt_long(argc, argv,
+				short_options, long_options, &idx);
+
+		if (-1 == c)
+			break;
+
+		switch (c) {
+		case 0: /* getopt_long() flag */
+			break;
+
+		case 'd':
+			if (n_devs == FRAMESET_MAX) {
+				fprintf(stderr, "at most %d devices\n",
+					FRAMESET_MAX);
+				exit(EXIT_FAILURE);
+			}
+			dev_names[n_devs++] = optarg;
+			break;
+
+		case 'h':
+			usage(stdout, argc, argv);
+			exit(EXIT_SUCCESS);
+
+		case 'f':
+			force_format++;
+			break;
+
+		case 't':
+			tolerance_ms = atoi(optarg);
+			break;
+
+		case 'c':
+			errno = 0;
+			set_count = strtol(optarg, NULL, 0);
+			if (errno)
+				errno_exit(optarg);
+			break;
+
+		case 'v':
+			verbose = 1;
+			break;
+
+		default:
+			usage(stderr, argc, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (n_devs < 2) {
+		usage(stderr, argc, argv);
+		exit(EXIT_FAILURE);
+	}
+
+	CLEAR(forced);
+	forced.width       = 640;
+	forced.height      = 480;
+	forced.pixelformat = V4L2_PIX_FMT_YUYV;
+	forced.field       = V4L2_FIELD_INTERLACED;
+
+	for (i = 0; i < n_devs; i++) {
+		if (v4lcap_open(&caps[i], dev_names[i], IO_METHOD_MMAP) ||
+		    v4lcap_set_format(&caps[i], force_format ? &forced : NULL) ||
+		    v4lcap_init_buffers(&caps[i]))
+			exit(EXIT_FAILURE);
+		capp[i] = &caps[i];
+		latency_init(&lat[i], dev_names[i]);
+	}
+	frameset_init(&sets, capp, n_devs, (uint64_t)tolerance_ms * 1000);
+
+	for (i = 0; i < n_devs; i++)
+		if (v4lcap_start(&caps[i]))
+			exit(EXIT_FAILURE);
+
+	mainloop();
+
+	for (i = 0; i < n_devs; i++) {
+		v4lcap_stop(&caps[i]);
+		v4lcap_close(&caps[i]);
+	}
+	report();
+	return 0;
+}
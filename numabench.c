@@ -0,0 +1,204 @@
+/*
+ *  Cross-node cost of the YUYV conversion
+ *
+ *  This program can be used and distributed without restrictions.
+ *
+ *  Runs yuyv_to_rgb24() with the worker bound to each node in turn and
+ *  the frames allocated on each node in turn, and prints the time per
+ *  frame as a cpu node x memory node matrix. The source frames cycle
+ *  through a ring larger than the last level cache, the way freshly
+ *  DMA'd capture buffers arrive cold, so the numbers include the trip
+ *  over the interconnect. With -d the node of the capture device is
+ *  marked, which is where v4lcapture places userptr buffers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <getopt.h>             /* getopt_long() */
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "convert.h"
+#include "topology.h"
+
+#define RING	16	/* source frames, > LLC at 1080p */
+#define OUTS	4	/* output frames */
+
+static int width = 1920;
+static int height = 1080;
+static int frame_count = 200;
+static char *dev_name;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* microseconds per frame with the worker on cpu_node, frames on mem_node */
+static double run(int cpu_node, int mem_node)
+{
+	size_t src_size = (size_t)width * height * 2;
+	size_t dst_size = (size_t)width * height * 3;
+	unsigned char *src[RING], *dst[OUTS];
+	uint64_t t;
+	int i;
+
+	/* allocate first: topo_alloc() faults the pages in from here */
+	for (i = 0; i < RING; i++) {
+		src[i] = topo_alloc(src_size, mem_node);
+		if (!src[i]) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		memset(src[i], 0x80 + i, src_size);
+	}
+	for (i = 0; i < OUTS; i++) {
+		dst[i] = topo_alloc(dst_size, mem_node);
+		if (!dst[i]) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (topo_bind_node(cpu_node))
+		exit(EXIT_FAILURE);
+
+	/* warm up the code and the TLB, not the data */
+	yuyv_to_rgb24(width, height, src[0], dst[0], NULL);
+
+	t = now_us();
+	for (i = 0; i < frame_count; i++)
+		yuyv_to_rgb24(width, height, src[i % RING], dst[i % OUTS],
+			      NULL);
+	t = now_us() - t;
+
+	for (i = 0; i < RING; i++)
+		topo_free(src[i], src_size);
+	for (i = 0; i < OUTS; i++)
+		topo_free(dst[i], dst_size);
+
+	return (double)t / frame_count;
+}
+
+static void usage(FILE *fp, int argc, char **argv)
+{
+	fprintf(fp,
+		 "Usage: %s [options]\n\n"
+		 "Options:\n"
+		 "-d | --device name   Mark the node of this capture device\n"
+		 "-h | --help          Print this message\n"
+		 "-W | --width n       Frame width [%i]\n"
+		 "-H | --height n      Frame height [%i]\n"
+		 "-c | --count         Frames per measurement [%i]\n"
+		 "",
+		 argv[0], width, height, frame_count);
+}
+
+static const char short_options[] = "d:hW:H:c:";
+
+static const struct option
+long_options[] = {
+	{ "device", required_argument, NULL, 'd' },
+	{ "help",   no_argument,       NULL, 'h' },
+	{ "width",  required_argument, NULL, 'W' },
+	{ "height", required_argument, NULL, 'H' },
+	{ "count",  required_argument, NULL, 'c' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	int nodes, dev_node = -1;
+	int c, m;
+	double us, local, worst;
+
+	for (;;) {
+		int idx;
+
+		c = getopt_long(argc, argv,
+				short_options, long_options, &idx);
+
+		if (-1 == c)
+			break;
+
+		switch (c) {
+		case 0: /* getopt_long() flag */
+			break;
+
+		case 'd':
+			dev_name = optarg;
+			break;
+
+		case 'h':
+			usage(stdout, argc, argv);
+			exit(EXIT_SUCCESS);
+
+		case 'W':
+			width = atoi(optarg) & ~1;
+			break;
+
+		case 'H':
+			height = atoi(optarg);
+			break;
+
+		case 'c':
+			frame_count = atoi(optarg);
+			break;
+
+		default:
+			usage(stderr, argc, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (width <= 0 || height <= 0 || frame_count <= 0) {
+		usage(stderr, argc, argv);
+		exit(EXIT_FAILURE);
+	}
+
+	if (dev_name) {
+		struct stat st;
+
+		if (-1 == stat(dev_name, &st)) {
+			fprintf(stderr, "Cannot identify '%s': %d, %s\n",
+				dev_name, errno, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		dev_node = topo_device_node(st.st_rdev);
+		printf("%s is on node %d\n", dev_name, dev_node);
+	}
+
+	nodes = topo_nodes();
+	printf("%dx%d yuyv_to_rgb24, us per frame (cpu node x memory node)\n",
+	       width, height);
+	printf("%-8s", "cpu");
+	for (m = 0; m < nodes; m++)
+		printf("   mem %-3d", m);
+	printf("\n");
+
+	for (c = 0; c < nodes; c++) {
+		printf("%-3d%-5s", c, c == dev_node ? " dev" : "");
+		local = worst = 0;
+		for (m = 0; m < nodes; m++) {
+			us = run(c, m);
+			if (m == c)
+				local = us;
+			else if (us > worst)
+				worst = us;
+			printf(" %9.0f", us);
+		}
+		/* the worst remote node against the local one */
+		if (nodes > 1 && local > 0)
+			printf("   remote +%.0f%%", 100.0 * (worst - local) / local);
+		printf("\n");
+	}
+	return 0;
+}
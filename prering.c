@@ -0,0 +1,213 @@
+/*
+ *  Pre-trigger ring of raw frames
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "prering.h"
+#include "recfile.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+#define HUGE_PAGE	(2UL << 20)
+
+static void dump(struct prering *r)
+{
+	char path[256];
+	struct rec_writer w;
+	struct v4l2_buffer buf;
+	uint64_t i, avail;
+	unsigned int first = 0, last = 0;
+	int ok;
+
+	snprintf(path, sizeof(path), "%s-%03u.v4r", r->prefix, r->dumps);
+	ok = !rec_create(&w, path, &r->fmt, &r->timeperframe);
+	memset(&buf, 0, sizeof(buf));
+
+	for (i = r->start; i < r->end; ) {
+		const struct prering_slot *m = &r->meta[i % r->nslots];
+
+		avail = __atomic_load_n(&r->pushed, __ATOMIC_ACQUIRE);
+		if (i >= avail) {
+			if (__atomic_load_n(&r->quit, __ATOMIC_ACQUIRE))
+				break;
+			while (-1 == sem_wait(&r->wake) && EINTR == errno)
+				;
+			continue;
+		}
+
+		if (i == r->start)
+			first = m->sequence;
+		last = m->sequence;
+		buf.sequence = m->sequence;
+		buf.flags = m->flags;
+		buf.timestamp = m->timestamp;
+		if (ok && rec_write(&w, r->mem + (i % r->nslots) * r->slot_size,
+				    m->size, &buf)) {
+			fprintf(stderr, "%s: dump aborted\n", path);
+			rec_close(&w);
+			ok = 0;
+		}
+		__atomic_store_n(&r->flushed, ++i, __ATOMIC_RELEASE);
+	}
+
+	if (ok && !rec_close(&w)) {
+		fprintf(stderr, "%s: %llu frames, sequence %u-%u\n", path,
+			(unsigned long long)(i - r->start), first, last);
+	}
+	r->dumps++;
+}
+
+static void *writer(void *arg)
+{
+	struct prering *r = arg;
+
+	for (;;) {
+		while (-1 == sem_wait(&r->wake) && EINTR == errno)
+			;
+		if (__atomic_load_n(&r->busy, __ATOMIC_ACQUIRE)) {
+			dump(r);
+			__atomic_store_n(&r->busy, 0, __ATOMIC_RELEASE);
+		}
+		if (__atomic_load_n(&r->quit, __ATOMIC_ACQUIRE))
+			break;
+	}
+	return NULL;
+}
+
+int prering_create(struct prering *r, const char *prefix,
+		   const struct v4l2_format *fmt,
+		   const struct v4l2_fract *timeperframe,
+		   unsigned int pre, unsigned int post, int huge)
+{
+	void *p = MAP_FAILED;
+	int err;
+
+	CLEAR(*r);
+	r->prefix = prefix;
+	r->fmt = *fmt;
+	if (timeperframe)
+		r->timeperframe = *timeperframe;
+	r->pre = pre;
+	r->post = post;
+	r->nslots = pre + post ? pre + post : 1;
+	r->slot_size = (fmt->fmt.pix.sizeimage + 63) & ~(size_t)63;
+	r->map_size = r->slot_size * r->nslots;
+
+	if (huge) {
+		size_t size = (r->map_size + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+
+		p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (MAP_FAILED != p) {
+			r->map_size = size;
+			r->huge = 1;
+		}
+	}
+	if (MAP_FAILED == p) {
+		p = mmap(NULL, r->map_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (MAP_FAILED == p) {
+			perror("mmap");
+			return -1;
+		}
+		if (huge)
+			madvise(p, r->map_size, MADV_HUGEPAGE);
+	}
+	r->mem = p;
+	/* fault everything in now, not in the capture loop */
+	memset(r->mem, 0, r->map_size);
+
+	r->meta = calloc(r->nslots, sizeof(*r->meta));
+	if (!r->meta) {
+		fprintf(stderr, "Out of memory\n");
+		goto fail;
+	}
+
+	if (-1 == sem_init(&r->wake, 0, 0)) {
+		perror("sem_init");
+		goto fail;
+	}
+	err = pthread_create(&r->thread, NULL, writer, r);
+	if (err) {
+		fprintf(stderr, "pthread_create error %d, %s\n",
+			err, strerror(err));
+		sem_destroy(&r->wake);
+		goto fail;
+	}
+	return 0;
+
+fail:
+	free(r->meta);
+	munmap(r->mem, r->map_size);
+	r->mem = NULL;
+	return -1;
+}
+
+int prering_push(struct prering *r, const void *data, size_t size,
+		 const struct v4l2_buffer *buf)
+{
+	uint64_t n = r->pushed;
+	struct prering_slot *m;
+	int busy = __atomic_load_n(&r->busy, __ATOMIC_ACQUIRE);
+
+	if (__atomic_exchange_n(&r->trigger, 0, __ATOMIC_ACQ_REL)) {
+		if (busy) {
+			r->ignored++;
+		} else {
+			r->start = n > r->pre ? n - r->pre : 0;
+			r->end = n + r->post;
+			r->flushed = r->start;
+			busy = 1;
+			__atomic_store_n(&r->busy, 1, __ATOMIC_RELEASE);
+			sem_post(&r->wake);
+		}
+	}
+
+	/* the oldest slot still has to go to disk */
+	if (busy && n - __atomic_load_n(&r->flushed, __ATOMIC_ACQUIRE)
+		    >= r->nslots) {
+		r->overruns++;
+		return -1;
+	}
+
+	if (size > r->slot_size)
+		size = r->slot_size;
+	memcpy(r->mem + (n % r->nslots) * r->slot_size, data, size);
+	m = &r->meta[n % r->nslots];
+	m->size = size;
+	m->sequence = buf->sequence;
+	m->flags = buf->flags;
+	m->timestamp = buf->timestamp;
+	__atomic_store_n(&r->pushed, n + 1, __ATOMIC_RELEASE);
+
+	if (busy)
+		sem_post(&r->wake);
+	return 0;
+}
+
+void prering_trigger(struct prering *r)
+{
+	__atomic_store_n(&r->trigger, 1, __ATOMIC_RELEASE);
+}
+
+void prering_destroy(struct prering *r)
+{
+	if (!r->mem)
+		return;
+	__atomic_store_n(&r->quit, 1, __ATOMIC_RELEASE);
+	sem_post(&r->wake);
+	pthread_join(r->thread, NULL);
+	sem_destroy(&r->wake);
+	free(r->meta);
+	munmap(r->mem, r->map_size);
+	r->mem = NULL;
+}
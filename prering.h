@@ -0,0 +1,85 @@
+/*
+ *  Pre-trigger ring of raw frames
+ *
+ *  The capture thread copies every frame into a fixed ring that holds
+ *  the last pre + post frames; memory is allocated and faulted in once,
+ *  optionally from huge pages. A trigger (prering_trigger(), safe to
+ *  call from a signal handler) makes a writer thread save the pre
+ *  frames before it and the post frames after it to <prefix>-NNN.v4r,
+ *  a recording as described in recfile.h.
+ *
+ *  The capture thread never waits for the disk: while a dump runs, the
+ *  ring only refuses frames that would overwrite ones not yet written
+ *  (counted in overruns). Triggers during a dump are counted and
+ *  ignored.
+ */
+
+#ifndef PRERING_H
+#define PRERING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <linux/videodev2.h>
+
+struct prering_slot {
+	uint32_t	size;
+	uint32_t	sequence;
+	uint32_t	flags;		/* v4l2_buffer.flags */
+	uint32_t	reserved;
+	struct timeval	timestamp;
+};
+
+struct prering {
+	unsigned char		*mem;
+	size_t			map_size;
+	size_t			slot_size;
+	unsigned int		nslots;
+	int			huge;		/* backed by MAP_HUGETLB */
+	struct prering_slot	*meta;
+	unsigned int		pre, post;	/* frames */
+	const char		*prefix;
+	struct v4l2_format	fmt;		/* for the recordings */
+	struct v4l2_fract	timeperframe;
+
+	uint64_t		pushed;		/* frames stored so far */
+	int			trigger;	/* pending, set asynchronously */
+	int			busy;		/* a dump is running */
+	uint64_t		start, end;	/* frames [start, end) to dump */
+	uint64_t		flushed;	/* next frame to write */
+
+	pthread_t		thread;
+	sem_t			wake;
+	int			quit;
+
+	unsigned int		dumps;
+	unsigned long		overruns;	/* frames refused during a dump */
+	unsigned long		ignored;	/* triggers during a dump */
+};
+
+/*
+ * Slots are fmt->fmt.pix.sizeimage large; timeperframe may be NULL.
+ * huge: try MAP_HUGETLB first, else ask for transparent huge pages.
+ * Returns 0 or -1.
+ */
+int prering_create(struct prering *r, const char *prefix,
+		   const struct v4l2_format *fmt,
+		   const struct v4l2_fract *timeperframe,
+		   unsigned int pre, unsigned int post, int huge);
+
+/*
+ * Capture thread: store one frame. No allocation or system call, apart
+ * from waking the writer during a dump. Returns 0, or -1 if the frame
+ * was refused because the writer is behind.
+ */
+int prering_push(struct prering *r, const void *data, size_t size,
+		 const struct v4l2_buffer *buf);
+
+/* Any thread or signal handler. Takes effect at the next push. */
+void prering_trigger(struct prering *r);
+
+/* Finish a running dump with the frames there are, free everything. */
+void prering_destroy(struct prering *r);
+
+#endif /* PRERING_H */
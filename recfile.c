@@ -0,0 +1,345 @@
+/*
+ *  Recording container
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#include "recfile.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+#define ALIGN_UP(x)	(((x) + REC_ALIGN - 1) & ~(uint64_t)(REC_ALIGN - 1))
+
+static const unsigned char zeros[REC_ALIGN];
+
+static int errno_msg(const char *s)
+{
+	int err = errno;
+
+	fprintf(stderr, "%s error %d, %s\n", s, err, strerror(err));
+	errno = err;
+	return -1;
+}
+
+static int writev_all(int fd, struct iovec *iov, int n)
+{
+	ssize_t r;
+
+	while (n) {
+		r = writev(fd, iov, n);
+		if (-1 == r) {
+			if (EINTR == errno)
+				continue;
+			return -1;
+		}
+		while (n && (size_t)r >= iov->iov_len) {
+			r -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n) {
+			iov->iov_base = (char *)iov->iov_base + r;
+			iov->iov_len -= r;
+		}
+	}
+	return 0;
+}
+
+/* pad the file up to the next record boundary */
+static int pad(struct rec_writer *w)
+{
+	struct iovec iov;
+
+	iov.iov_base = (void *)zeros;
+	iov.iov_len = ALIGN_UP(w->offset) - w->offset;
+	if (!iov.iov_len)
+		return 0;
+	if (writev_all(w->fd, &iov, 1))
+		return errno_msg("write");
+	w->offset += iov.iov_len;
+	return 0;
+}
+
+int rec_create(struct rec_writer *w, const char *path,
+	       const struct v4l2_format *fmt,
+	       const struct v4l2_fract *timeperframe)
+{
+	struct rec_header hdr;
+	struct iovec iov;
+
+	CLEAR(*w);
+	if (!strcmp(path, "-"))
+		w->fd = STDOUT_FILENO;
+	else
+		w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (-1 == w->fd) {
+		fprintf(stderr, "Cannot create '%s': %d, %s\n",
+			path, errno, strerror(errno));
+		return -1;
+	}
+	w->seekable = -1 != lseek(w->fd, 0, SEEK_CUR);
+
+	CLEAR(hdr);
+	memcpy(hdr.magic, REC_MAGIC, sizeof(hdr.magic));
+	hdr.version = REC_VERSION;
+	hdr.align = REC_ALIGN;
+	hdr.header_size = sizeof(hdr);
+	hdr.fmt_size = sizeof(hdr.fmt);
+	if (timeperframe)
+		hdr.timeperframe = *timeperframe;
+	hdr.fmt = *fmt;
+
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof(hdr);
+	if (writev_all(w->fd, &iov, 1))
+		return errno_msg("write");
+	w->offset = sizeof(hdr);
+	return pad(w);
+}
+
+int rec_write(struct rec_writer *w, const void *data, size_t size,
+	      const struct v4l2_buffer *buf)
+{
+	struct rec_frame rf;
+	struct rec_index *e;
+	struct iovec iov[3];
+	uint64_t end;
+
+	if (w->frames == w->alloc) {
+		size_t n = w->alloc ? 2 * w->alloc : 1024;
+		struct rec_index *p = realloc(w->index, n * sizeof(*p));
+
+		if (!p) {
+			fprintf(stderr, "Out of memory\n");
+			errno = ENOMEM;
+			return -1;
+		}
+		w->index = p;
+		w->alloc = n;
+	}
+
+	CLEAR(rf);
+	rf.magic = REC_FRAME_MAGIC;
+	rf.size = size;
+	rf.sequence = buf->sequence;
+	rf.flags = buf->flags;
+	rf.timestamp = (uint64_t)buf->timestamp.tv_sec * 1000000
+		+ buf->timestamp.tv_usec;
+
+	/* record and the padding behind it in one system call */
+	end = w->offset + sizeof(rf) + size;
+	iov[0].iov_base = &rf;
+	iov[0].iov_len = sizeof(rf);
+	iov[1].iov_base = (void *)data;
+	iov[1].iov_len = size;
+	iov[2].iov_base = (void *)zeros;
+	iov[2].iov_len = ALIGN_UP(end) - end;
+	if (writev_all(w->fd, iov, iov[2].iov_len ? 3 : 2))
+		return errno_msg("write");
+
+	e = &w->index[w->frames++];
+	e->offset = w->offset;
+	e->timestamp = rf.timestamp;
+	e->sequence = rf.sequence;
+	e->size = size;
+	w->offset = ALIGN_UP(end);
+	return 0;
+}
+
+int rec_close(struct rec_writer *w)
+{
+	struct rec_trailer tr;
+	struct iovec iov[2];
+	uint64_t index_offset = w->offset;
+	int ret = 0;
+
+	CLEAR(tr);
+	memcpy(tr.magic, REC_TRAILER_MAGIC, sizeof(tr.magic));
+	tr.index_offset = index_offset;
+	tr.frames = w->frames;
+
+	iov[0].iov_base = w->index;
+	iov[0].iov_len = w->frames * sizeof(*w->index);
+	iov[1].iov_base = &tr;
+	iov[1].iov_len = sizeof(tr);
+	if (writev_all(w->fd, iov, 2))
+		ret = errno_msg("write");
+
+	if (!ret && w->seekable) {
+		/* index_offset and frames are adjacent in the header */
+		uint64_t patch[2] = { index_offset, w->frames };
+
+		if (-1 == pwrite(w->fd, patch, sizeof(patch),
+				 offsetof(struct rec_header, index_offset)))
+			ret = errno_msg("pwrite");
+	}
+
+	if (STDOUT_FILENO != w->fd && -1 == close(w->fd))
+		ret = errno_msg("close");
+	free(w->index);
+	w->index = NULL;
+	w->fd = -1;
+	return ret;
+}
+
+/* no usable index: walk the records of a recording that was cut short */
+static int rebuild(struct rec_reader *r)
+{
+	uint64_t off = ALIGN_UP(sizeof(struct rec_header));
+	size_t alloc = 0;
+
+	r->frames = 0;
+	while (off + sizeof(struct rec_frame) <= r->size) {
+		const struct rec_frame *rf = (const void *)(r->map + off);
+		struct rec_index *e;
+
+		if (REC_FRAME_MAGIC != rf->magic ||
+		    off + sizeof(*rf) + rf->size > r->size)
+			break;
+		if (r->frames == alloc) {
+			alloc = alloc ? 2 * alloc : 1024;
+			e = realloc(r->rebuilt, alloc * sizeof(*e));
+			if (!e) {
+				fprintf(stderr, "Out of memory\n");
+				errno = ENOMEM;
+				return -1;
+			}
+			r->rebuilt = e;
+		}
+		e = &r->rebuilt[r->frames++];
+		e->offset = off;
+		e->timestamp = rf->timestamp;
+		e->sequence = rf->sequence;
+		e->size = rf->size;
+		off = ALIGN_UP(off + sizeof(*rf) + rf->size);
+	}
+	r->index = r->rebuilt;
+	fprintf(stderr, "no index, recovered %zu frames\n", r->frames);
+	return 0;
+}
+
+static int index_ok(const struct rec_reader *r, uint64_t off, uint64_t n)
+{
+	return off >= sizeof(struct rec_header) && off <= r->size &&
+		n <= (r->size - off) / sizeof(struct rec_index);
+}
+
+static int open_map(struct rec_reader *r, const char *path)
+{
+	const struct rec_trailer *tr;
+	struct stat st;
+	void *p;
+
+	r->fd = open(path, O_RDONLY);
+	if (-1 == r->fd) {
+		fprintf(stderr, "Cannot open '%s': %d, %s\n",
+			path, errno, strerror(errno));
+		return -1;
+	}
+	if (-1 == fstat(r->fd, &st))
+		return errno_msg("fstat");
+	if ((uint64_t)st.st_size < sizeof(struct rec_header)) {
+		fprintf(stderr, "%s: too short\n", path);
+		errno = EINVAL;
+		return -1;
+	}
+
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, r->fd, 0);
+	if (MAP_FAILED == p)
+		return errno_msg("mmap");
+	r->map = p;
+	r->size = st.st_size;
+	r->hdr = p;
+
+	if (memcmp(r->hdr->magic, REC_MAGIC, sizeof(r->hdr->magic)) ||
+	    REC_VERSION != r->hdr->version || REC_ALIGN != r->hdr->align ||
+	    sizeof(struct rec_header) != r->hdr->header_size ||
+	    sizeof(struct v4l2_format) != r->hdr->fmt_size) {
+		fprintf(stderr, "%s: not a recording of this version\n", path);
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (r->hdr->index_offset &&
+	    index_ok(r, r->hdr->index_offset, r->hdr->frames)) {
+		r->index = (const void *)(r->map + r->hdr->index_offset);
+		r->frames = r->hdr->frames;
+		return 0;
+	}
+
+	tr = (const void *)(r->map + r->size - sizeof(*tr));
+	if (!memcmp(tr->magic, REC_TRAILER_MAGIC, sizeof(tr->magic)) &&
+	    index_ok(r, tr->index_offset, tr->frames)) {
+		r->index = (const void *)(r->map + tr->index_offset);
+		r->frames = tr->frames;
+		return 0;
+	}
+
+	return rebuild(r);
+}
+
+int rec_open(struct rec_reader *r, const char *path)
+{
+	int err;
+
+	CLEAR(*r);
+	r->fd = -1;
+	if (!open_map(r, path))
+		return 0;
+	err = errno;
+	rec_release(r);
+	errno = err;
+	return -1;
+}
+
+const void *rec_frame_data(const struct rec_reader *r, size_t i,
+			   const struct rec_index **e)
+{
+	const struct rec_index *x;
+
+	if (i >= r->frames)
+		return NULL;
+	x = &r->index[i];
+	/* the index is not trusted more than the frames it points at */
+	if (x->offset < sizeof(struct rec_header) || x->offset > r->size ||
+	    r->size - x->offset < sizeof(struct rec_frame) + (uint64_t)x->size)
+		return NULL;
+	if (e)
+		*e = x;
+	return r->map + x->offset + sizeof(struct rec_frame);
+}
+
+size_t rec_seek(const struct rec_reader *r, uint64_t ts)
+{
+	size_t lo = 0, hi = r->frames, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (r->index[mid].timestamp < ts)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+void rec_release(struct rec_reader *r)
+{
+	if (r->map)
+		munmap((void *)r->map, r->size);
+	if (-1 != r->fd)
+		close(r->fd);
+	free(r->rebuilt);
+	CLEAR(*r);
+	r->fd = -1;
+}
@@ -0,0 +1,114 @@
+/*
+ *  Recording container
+ *
+ *  A recording is
+ *
+ *	struct rec_header		format, frame interval, where the index is
+ *	frame records			each at a multiple of REC_ALIGN:
+ *	  struct rec_frame		  64 bytes
+ *	  data				  rec_frame.size bytes, 64-byte aligned
+ *	struct rec_index[frames]	appended when the recording is closed
+ *	struct rec_trailer		last 32 bytes of the file
+ *
+ *  The writer only ever appends, so it can stream into a pipe. If the
+ *  file is seekable it also patches the header with the index position;
+ *  otherwise the reader finds the index through the trailer. A recording
+ *  cut short (no trailer) is indexed by walking the records once.
+ *
+ *  The reader maps the file: looking up frame i is one index entry, and
+ *  threads can work on different frames of the same mapping.
+ */
+
+#ifndef RECFILE_H
+#define RECFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/videodev2.h>
+
+#define REC_MAGIC		"V4LREC1"	/* 8 bytes with the NUL */
+#define REC_TRAILER_MAGIC	"V4LRIDX"
+#define REC_FRAME_MAGIC		0x454d5246	/* "FRME" */
+#define REC_VERSION		1
+#define REC_ALIGN		4096
+
+struct rec_header {
+	char			magic[8];
+	uint32_t		version;
+	uint32_t		align;		/* REC_ALIGN */
+	uint32_t		header_size;	/* sizeof(struct rec_header) */
+	uint32_t		fmt_size;	/* sizeof(struct v4l2_format) */
+	uint64_t		index_offset;	/* 0 if not patched */
+	uint64_t		frames;
+	struct v4l2_fract	timeperframe;	/* 0/0 if unknown */
+	uint32_t		reserved[10];
+	struct v4l2_format	fmt;
+};
+
+struct rec_frame {
+	uint32_t		magic;		/* REC_FRAME_MAGIC */
+	uint32_t		size;
+	uint32_t		sequence;
+	uint32_t		flags;		/* v4l2_buffer.flags */
+	uint64_t		timestamp;	/* us */
+	uint32_t		reserved[10];
+};
+
+struct rec_index {
+	uint64_t		offset;		/* of the struct rec_frame */
+	uint64_t		timestamp;
+	uint32_t		sequence;
+	uint32_t		size;
+};
+
+struct rec_trailer {
+	char			magic[8];
+	uint64_t		index_offset;
+	uint64_t		frames;
+	uint64_t		reserved;
+};
+
+struct rec_writer {
+	int			fd;
+	int			seekable;
+	uint64_t		offset;		/* end of what is written */
+	struct rec_index	*index;
+	size_t			frames, alloc;
+};
+
+/* path "-" is stdout. timeperframe may be NULL. Returns 0 or -1. */
+int rec_create(struct rec_writer *w, const char *path,
+	       const struct v4l2_format *fmt,
+	       const struct v4l2_fract *timeperframe);
+
+int rec_write(struct rec_writer *w, const void *data, size_t size,
+	      const struct v4l2_buffer *buf);
+
+/* Append the index and trailer, patch the header, close. */
+int rec_close(struct rec_writer *w);
+
+struct rec_reader {
+	int			fd;
+	const unsigned char	*map;
+	size_t			size;
+	const struct rec_header	*hdr;
+	const struct rec_index	*index;
+	size_t			frames;
+	struct rec_index	*rebuilt;	/* if the index had to be rebuilt */
+};
+
+int rec_open(struct rec_reader *r, const char *path);
+
+/*
+ * Frame i, or NULL if out of range or if its index entry points outside
+ * the file (truncated or corrupt); *e gets the entry if e.
+ */
+const void *rec_frame_data(const struct rec_reader *r, size_t i,
+			   const struct rec_index **e);
+
+/* First frame with timestamp >= ts (binary search), or r->frames. */
+size_t rec_seek(const struct rec_reader *r, uint64_t ts);
+
+void rec_release(struct rec_reader *r);
+
+#endif /* RECFILE_H */
@@ -0,0 +1,241 @@
+/*
+ *  Inspect, extract and reprocess recordings
+ *
+ *  This program can be used and distributed without restrictions.
+ *
+ *  Works on the files written by "demo1 -O file" and the pre-trigger
+ *  dumps; see recfile.h for the layout. Every frame is found through
+ *  the index in the mapped file, so extracting frame n or the frame at
+ *  a time does not read the frames before it, and -b converts frames
+ *  on all cores straight out of the mapping.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <getopt.h>             /* getopt_long() */
+
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "recfile.h"
+#include "convert.h"
+
+static struct rec_reader rec;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void info(void)
+{
+	const struct v4l2_pix_format *pix = &rec.hdr->fmt.fmt.pix;
+	const struct v4l2_fract *tpf = &rec.hdr->timeperframe;
+	uint64_t t0 = 0, t1 = 0;
+
+	if (rec.frames) {
+		t0 = rec.index[0].timestamp;
+		t1 = rec.index[rec.frames - 1].timestamp;
+	}
+	printf("%ux%u %.4s, %u bytes per line, %u per frame\n",
+	       pix->width, pix->height, (const char *)&pix->pixelformat,
+	       pix->bytesperline, pix->sizeimage);
+	if (tpf->numerator)
+		printf("%.2f fps nominal\n",
+		       (double)tpf->denominator / tpf->numerator);
+	printf("%zu frames, %.3f s, sequence %u-%u\n", rec.frames,
+	       (t1 - t0) / 1e6,
+	       rec.frames ? rec.index[0].sequence : 0,
+	       rec.frames ? rec.index[rec.frames - 1].sequence : 0);
+}
+
+static void list(void)
+{
+	size_t i;
+
+	printf("%8s %10s %12s %14s %10s\n",
+	       "frame", "sequence", "offset", "timestamp us", "size");
+	for (i = 0; i < rec.frames; i++)
+		printf("%8zu %10u %12llu %14llu %10u\n", i,
+		       rec.index[i].sequence,
+		       (unsigned long long)rec.index[i].offset,
+		       (unsigned long long)rec.index[i].timestamp,
+		       rec.index[i].size);
+}
+
+static int extract(size_t n)
+{
+	const struct rec_index *e;
+	const void *p = rec_frame_data(&rec, n, &e);
+
+	if (!p) {
+		fprintf(stderr, "no frame %zu, %zu frames%s\n", n, rec.frames,
+			n < rec.frames ? ", its index entry is corrupt" : "");
+		return -1;
+	}
+	fprintf(stderr, "frame %zu: sequence %u, %llu us\n", n, e->sequence,
+		(unsigned long long)e->timestamp);
+	return 1 == fwrite(p, e->size, 1, stdout) ? 0 : -1;
+}
+
+/* convert every frame, in parallel, to measure offline throughput */
+static int bench(void)
+{
+	const struct v4l2_pix_format *pix = &rec.hdr->fmt.fmt.pix;
+	const struct yuyv_conv *cv = yuyv_conv_select(pix);
+	size_t out_size = (size_t)pix->width * pix->height * 3;
+	int stride = pix->bytesperline ? (int)pix->bytesperline
+				       : (int)pix->width * 2;
+	unsigned long bad = 0;
+	int threads = 1;
+	uint64_t t;
+	long i;
+
+	if (V4L2_PIX_FMT_YUYV != pix->pixelformat) {
+		fprintf(stderr, "only YUYV recordings can be converted\n");
+		return -1;
+	}
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#endif
+
+	t = now_us();
+#pragma omp parallel
+	{
+		unsigned char *out = malloc(out_size);
+
+#pragma omp for schedule(dynamic, 4) reduction(+:bad)
+		for (i = 0; i < (long)rec.frames; i++) {
+			const struct rec_index *e;
+			const void *p = rec_frame_data(&rec, i, &e);
+
+			if (!p || e->size < (uint64_t)stride * pix->height) {
+				bad++;
+				continue;
+			}
+			if (out)
+				yuyv_conv_frame(cv, pix->width, pix->height, p,
+						stride, out, NULL);
+		}
+		free(out);
+	}
+	t = now_us() - t;
+
+	printf("%zu frames converted in %.3f s on %d threads, %.1f fps\n",
+	       rec.frames - bad, t / 1e6, threads,
+	       t ? (rec.frames - bad) * 1e6 / t : 0.0);
+	if (bad)
+		fprintf(stderr, "%lu frames skipped, outside the file or "
+			"short\n", bad);
+	return 0;
+}
+
+static void usage(FILE *fp, int argc, char **argv)
+{
+	fprintf(fp,
+		 "Usage: %s [options] file\n\n"
+		 "Options:\n"
+		 "-h | --help          Print this message\n"
+		 "-l | --list          List the index\n"
+		 "-x | --extract n     Write frame n to stdout\n"
+		 "-s | --seek us       Write the first frame at or after us\n"
+		 "                     from the start to stdout\n"
+		 "-b | --bench         Convert all frames on all cores\n"
+		 "",
+		 argv[0]);
+}
+
+static const char short_options[] = "hlx:s:b";
+
+static const struct option
+long_options[] = {
+	{ "help",    no_argument,       NULL, 'h' },
+	{ "list",    no_argument,       NULL, 'l' },
+	{ "extract", required_argument, NULL, 'x' },
+	{ "seek",    required_argument, NULL, 's' },
+	{ "bench",   no_argument,       NULL, 'b' },
+	{ 0, 0, 0, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	int do_list = 0, do_bench = 0, ret = 0;
+	long extract_n = -1;
+	long long seek_us = -1;
+
+	for (;;) {
+		int idx;
+		int c;
+
+		c = getopt_long(argc, argv,
+				short_options, long_options, &idx);
+
+		if (-1 == c)
+			break;
+
+		switch (c) {
+		case 0: /* getopt_long() flag */
+			break;
+
+		case 'h':
+			usage(stdout, argc, argv);
+			exit(EXIT_SUCCESS);
+
+		case 'l':
+			do_list = 1;
+			break;
+
+		case 'x':
+			extract_n = atol(optarg);
+			break;
+
+		case 's':
+			seek_us = atoll(optarg);
+			break;
+
+		case 'b':
+			do_bench = 1;
+			break;
+
+		default:
+			usage(stderr, argc, argv);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind != argc - 1) {
+		usage(stderr, argc, argv);
+		exit(EXIT_FAILURE);
+	}
+
+	if (rec_open(&rec, argv[optind]))
+		exit(EXIT_FAILURE);
+
+	if (extract_n >= 0) {
+		ret = extract(extract_n);
+	} else if (seek_us >= 0) {
+		uint64_t t0 = rec.frames ? rec.index[0].timestamp : 0;
+
+		ret = extract(rec_seek(&rec, t0 + seek_us));
+	} else {
+		/* keep stdout for frame data when extracting */
+		info();
+		if (do_list)
+			list();
+		if (do_bench)
+			ret = bench();
+	}
+
+	rec_release(&rec);
+	return ret ? EXIT_FAILURE : 0;
+}
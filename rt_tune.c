@@ -0,0 +1,47 @@
+/*
+ *  Real-time tuning of the capture thread
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#define _GNU_SOURCE		/* CPU_SET() */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "rt_tune.h"
+
+int rt_pin_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	/* pid 0: the calling thread */
+	if (-1 == sched_setaffinity(0, sizeof(set), &set)) {
+		fprintf(stderr, "pinning to cpu %d error %d, %s\n",
+			cpu, errno, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+int rt_sched_fifo(int prio)
+{
+	struct sched_param param;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = prio;
+	if (-1 == sched_setscheduler(0, SCHED_FIFO, &param)) {
+		fprintf(stderr, "SCHED_FIFO %d error %d, %s\n",
+			prio, errno, strerror(errno));
+		return -1;
+	}
+	if (-1 == mlockall(MCL_CURRENT | MCL_FUTURE))
+		fprintf(stderr, "mlockall error %d, %s (continuing)\n",
+			errno, strerror(errno));
+	return 0;
+}
@@ -0,0 +1,28 @@
+/*
+ *  Real-time tuning of the capture thread
+ */
+
+#ifndef RT_TUNE_H
+#define RT_TUNE_H
+
+/* Pin the calling thread to one CPU. Returns 0 or -1. */
+int rt_pin_cpu(int cpu);
+
+/*
+ * Run the calling thread SCHED_FIFO at the given priority (1..99) and
+ * lock all memory so the capture loop takes no page faults. Needs
+ * CAP_SYS_NICE (or an rtprio rlimit) and enough RLIMIT_MEMLOCK.
+ */
+int rt_sched_fifo(int prio);
+
+/* pause hint for busy loops */
+static inline void rt_cpu_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+#endif /* RT_TUNE_H */
@@ -0,0 +1,115 @@
+/*
+ *  Shared-memory live statistics page
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "shm_stats.h"
+
+static void stats_path(char *path, size_t len, const char *name)
+{
+	snprintf(path, len, SHM_STATS_DIR SHM_STATS_PREFIX "%s", name);
+}
+
+struct shm_stats *shm_stats_create(const char *name, const char *device)
+{
+	struct shm_stats *s;
+	char path[256];
+	int fd;
+
+	stats_path(path, sizeof(path), name);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (-1 == fd) {
+		perror(path);
+		return NULL;
+	}
+	if (-1 == ftruncate(fd, sizeof(*s))) {
+		perror(path);
+		close(fd);
+		return NULL;
+	}
+	s = mmap(NULL, sizeof(*s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == s) {
+		perror(path);
+		return NULL;
+	}
+
+	s->version = SHM_STATS_VERSION;
+	s->pid = getpid();
+	s->size = sizeof(*s);
+	strncpy(s->device, device, sizeof(s->device) - 1);
+	s->d.exposure = -1;
+	s->d.gain = -1;
+	/* readers check the magic last */
+	__atomic_store_n(&s->magic, SHM_STATS_MAGIC, __ATOMIC_RELEASE);
+	return s;
+}
+
+void shm_stats_destroy(struct shm_stats *s, const char *name)
+{
+	char path[256];
+
+	if (!s)
+		return;
+	munmap(s, sizeof(*s));
+	stats_path(path, sizeof(path), name);
+	unlink(path);
+}
+
+const struct shm_stats *shm_stats_open(const char *name)
+{
+	const struct shm_stats *s;
+	char path[256];
+	int fd;
+
+	stats_path(path, sizeof(path), name);
+	fd = open(path, O_RDONLY);
+	if (-1 == fd) {
+		perror(path);
+		return NULL;
+	}
+	s = mmap(NULL, sizeof(*s), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (MAP_FAILED == s) {
+		perror(path);
+		return NULL;
+	}
+	if (__atomic_load_n(&s->magic, __ATOMIC_ACQUIRE) != SHM_STATS_MAGIC ||
+	    s->version != SHM_STATS_VERSION || s->size != sizeof(*s)) {
+		fprintf(stderr, "%s: not a v4l-capture stats page\n", path);
+		munmap((void *)s, sizeof(*s));
+		return NULL;
+	}
+	return s;
+}
+
+void shm_stats_publish(struct shm_stats *s, const struct shm_stats_data *d)
+{
+	uint32_t seq = s->seq;
+
+	__atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(&s->d, d, sizeof(*d));
+	__atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+uint32_t shm_stats_read(const struct shm_stats *s, struct shm_stats_data *d)
+{
+	uint32_t seq1, seq2;
+
+	do {
+		seq1 = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		memcpy(d, (const void *)&s->d, sizeof(*d));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq2 = __atomic_load_n(&s->seq, __ATOMIC_RELAXED);
+	} while ((seq1 & 1) || seq1 != seq2);
+
+	return seq1;
+}
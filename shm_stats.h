@@ -0,0 +1,63 @@
+/*
+ *  Shared-memory live statistics page
+ *
+ *  The capture loop publishes its counters into a small file under
+ *  /dev/shm which any number of readers (see statwatch.c) can map. The
+ *  page is guarded by a sequence lock: the writer never waits and issues
+ *  no system call, readers retry if they raced with an update.
+ */
+
+#ifndef SHM_STATS_H
+#define SHM_STATS_H
+
+#include <stdint.h>
+
+#define SHM_STATS_DIR		"/dev/shm/"
+#define SHM_STATS_PREFIX	"v4l-capture-"
+#define SHM_STATS_MAGIC		0x5334564c	/* "LV4S" */
+#define SHM_STATS_VERSION	2
+
+struct shm_stats_data {
+	uint64_t	frames;
+	uint64_t	drops;		/* sequence gaps reported by the driver */
+	uint64_t	timestamp;	/* us, driver timestamp of the last frame */
+	double		fps;		/* from driver timestamps */
+	double		jitter;		/* us, interval standard deviation */
+	uint32_t	dqbuf_us;	/* capture -> VIDIOC_DQBUF */
+	uint32_t	process_us;	/* process_image() */
+	uint32_t	queued;		/* buffers owned by the driver */
+	uint32_t	n_buffers;
+	int32_t		exposure;	/* -1 if unknown */
+	int32_t		gain;
+	uint64_t	skipped;	/* static frames not processed */
+};
+
+struct shm_stats {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	pid;
+	uint32_t	size;		/* sizeof(struct shm_stats) */
+	char		device[32];
+	uint32_t	seq;		/* odd while an update is in flight */
+	uint32_t	reserved;
+	struct shm_stats_data d;
+};
+
+/*
+ * Create /dev/shm/v4l-capture-<name> and map it. name is usually the
+ * device basename, e.g. "video0". Returns NULL on failure.
+ */
+struct shm_stats *shm_stats_create(const char *name, const char *device);
+
+void shm_stats_destroy(struct shm_stats *s, const char *name);
+
+/* Map an existing page read-only. Returns NULL on failure. */
+const struct shm_stats *shm_stats_open(const char *name);
+
+/* Writer side: copy d into the page. No system call. */
+void shm_stats_publish(struct shm_stats *s, const struct shm_stats_data *d);
+
+/* Reader side: consistent snapshot of the page. Returns the sequence. */
+uint32_t shm_stats_read(const struct shm_stats *s, struct shm_stats_data *d);
+
+#endif /* SHM_STATS_H */
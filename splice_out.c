@@ -0,0 +1,181 @@
+/*
+ *  Zero-copy frame output into a pipe
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#define _GNU_SOURCE	/* vmsplice(), F_SETPIPE_SZ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "splice_out.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+#define WAIT_NS	500000	/* between looks at a pipe that is not read */
+
+static int errno_msg(const char *s)
+{
+	int err = errno;
+
+	fprintf(stderr, "%s error %d, %s\n", s, err, strerror(err));
+	errno = err;
+	return -1;
+}
+
+int splice_out_init(struct splice_out *so, int fd, struct v4lcap *cap)
+{
+	struct stat st;
+	int size;
+
+	CLEAR(*so);
+	so->fd = fd;
+	if (-1 == fstat(fd, &st))
+		return errno_msg("fstat");
+
+	/* read() refills the same buffer, there is nothing to hold back */
+	so->pipe = S_ISFIFO(st.st_mode) && IO_METHOD_READ != cap->io;
+	if (!so->pipe)
+		return 0;
+
+	so->max_held = cap->n_buffers > 2 ? cap->n_buffers - 2 : 1;
+	if (so->max_held > SPLICE_OUT_MAX)
+		so->max_held = SPLICE_OUT_MAX;
+
+	/* fails beyond /proc/sys/fs/pipe-max-size, the default is fine too */
+	size = cap->fmt.fmt.pix.sizeimage * so->max_held;
+	if (size > 0 && -1 == fcntl(fd, F_SETPIPE_SZ, size))
+		fcntl(fd, F_SETPIPE_SZ, cap->fmt.fmt.pix.sizeimage);
+	return 0;
+}
+
+/* bytes put into the pipe that the reader has taken */
+static int consumed(struct splice_out *so, uint64_t *done)
+{
+	int unread;
+
+	if (-1 == ioctl(so->fd, FIONREAD, &unread))
+		return errno_msg("FIONREAD");
+	/* never release on a miscount, only hold longer */
+	*done = (uint64_t)unread < so->piped ? so->piped - unread : 0;
+	return 0;
+}
+
+int splice_out_reap(struct splice_out *so)
+{
+	uint64_t done;
+
+	if (!so->count)
+		return 0;
+	if (consumed(so, &done))
+		return -1;
+	while (so->count && so->end[so->first] <= done) {
+		if (frame_ref_put(so->held[so->first]))
+			return -1;
+		so->first = (so->first + 1) % SPLICE_OUT_MAX;
+		so->count--;
+	}
+	return 0;
+}
+
+/* until fewer than max frames are held */
+static int wait_below(struct splice_out *so, unsigned int max)
+{
+	struct timespec ts = { 0, WAIT_NS };
+
+	for (;;) {
+		if (splice_out_reap(so))
+			return -1;
+		if (so->count < max)
+			return 0;
+		nanosleep(&ts, NULL);
+	}
+}
+
+/* counted like spliced bytes: FIONREAD does not tell them apart */
+static int write_all(struct splice_out *so, const unsigned char *p, size_t n)
+{
+	ssize_t r;
+
+	while (n) {
+		r = write(so->fd, p, n);
+		if (-1 == r) {
+			if (EINTR == errno)
+				continue;
+			return errno_msg("write");
+		}
+		p += r;
+		n -= r;
+		so->piped += r;
+	}
+	return 0;
+}
+
+int splice_out_frame(struct splice_out *so, struct frame_ref *ref)
+{
+	struct v4lcap_frame *frame = &ref->frame;
+	struct iovec iov;
+	unsigned int slot;
+	ssize_t r;
+
+	so->frames++;
+	iov.iov_base = frame->start;
+	iov.iov_len = frame->bytesused;
+
+	if (so->pipe) {
+		if (so->count == so->max_held) {
+			so->waits++;
+			if (wait_below(so, so->max_held))
+				return -1;
+		}
+
+		while (iov.iov_len) {
+			r = vmsplice(so->fd, &iov, 1, 0);
+			if (-1 == r) {
+				if (EINTR == errno)
+					continue;
+				/* e.g. EFAULT on buffers that cannot be pinned */
+				fprintf(stderr, "vmsplice error %d, %s, "
+					"writing instead\n", errno,
+					strerror(errno));
+				so->pipe = 0;
+				break;
+			}
+			iov.iov_base = (char *)iov.iov_base + r;
+			iov.iov_len -= r;
+			so->piped += r;
+		}
+
+		/* part or all of it is referenced by the pipe */
+		if (iov.iov_len < frame->bytesused) {
+			if (iov.iov_len) {
+				so->copied++;
+				if (write_all(so, iov.iov_base, iov.iov_len))
+					return -1;
+			}
+			slot = (so->first + so->count) % SPLICE_OUT_MAX;
+			so->held[slot] = frame_ref_get(ref);
+			so->end[slot] = so->piped;
+			so->count++;
+			return splice_out_reap(so);
+		}
+	}
+
+	so->copied++;
+	if (write_all(so, iov.iov_base, iov.iov_len))
+		return -1;
+	return splice_out_reap(so);
+}
+
+int splice_out_flush(struct splice_out *so)
+{
+	return wait_below(so, 1);
+}
@@ -0,0 +1,62 @@
+/*
+ *  Zero-copy frame output into a pipe
+ *
+ *  Captured buffers are handed to the pipe with vmsplice(): the pipe
+ *  references the pages of the buffer instead of a copy of them, so a
+ *  frame piped into an encoder or a storage daemon is never copied in
+ *  user space. The flip side is that the driver must not refill those
+ *  pages before the reader has taken them, so a reference to each frame
+ *  is kept until the bytes still unread in the pipe (FIONREAD) no longer
+ *  reach into it.
+ *
+ *  If the output is not a pipe or vmsplice() fails, e.g. on buffers the
+ *  kernel cannot pin, the frame is written with write() and no
+ *  reference is kept.
+ */
+
+#ifndef SPLICE_OUT_H
+#define SPLICE_OUT_H
+
+#include <stdint.h>
+
+#include "v4lcapture.h"
+#include "frameref.h"
+
+#define SPLICE_OUT_MAX	32	/* frames held at most */
+
+struct splice_out {
+	int			fd;
+	int			pipe;		/* vmsplice() possible */
+	unsigned int		max_held;
+
+	/* frames in the pipe, oldest first, and where their pages end */
+	struct frame_ref	*held[SPLICE_OUT_MAX];
+	uint64_t		end[SPLICE_OUT_MAX];
+	unsigned int		first, count;
+	uint64_t		piped;		/* bytes into fd, spliced or written */
+
+	unsigned long		frames;
+	unsigned long		copied;		/* written, not spliced */
+	unsigned long		waits;		/* all buffers were in the pipe */
+};
+
+/*
+ * Output to fd, frames of cap. At most all but two of its buffers are
+ * held, so the driver always has one to fill. The pipe is grown to hold
+ * that many frames where the system allows it.
+ */
+int splice_out_init(struct splice_out *so, int fd, struct v4lcap *cap);
+
+/*
+ * Output one frame. so keeps its own reference to it until the reader
+ * has consumed it. Returns -1 with errno set if the output failed.
+ */
+int splice_out_frame(struct splice_out *so, struct frame_ref *ref);
+
+/* Drop the frames the reader is done with, without waiting. */
+int splice_out_reap(struct splice_out *so);
+
+/* Wait until the reader has everything, e.g. before stopping. */
+int splice_out_flush(struct splice_out *so);
+
+#endif /* SPLICE_OUT_H */
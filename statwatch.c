@@ -0,0 +1,47 @@
+/*
+ *  Watch the live statistics of a running capture
+ *
+ *  This program can be used and distributed without restrictions.
+ *
+ *  usage: statwatch [name] [interval ms]
+ *  name defaults to "video0", i.e. the page of "demo -S -d /dev/video0".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "shm_stats.h"
+
+int main(int argc, char **argv)
+{
+	const struct shm_stats *s;
+	struct shm_stats_data d;
+	const char *name = argc > 1 ? argv[1] : "video0";
+	int interval = argc > 2 ? atoi(argv[2]) : 1000;
+	uint32_t seq, last = 0;
+
+	s = shm_stats_open(name);
+	if (!s)
+		exit(EXIT_FAILURE);
+
+	printf("%s (pid %u)\n", s->device, s->pid);
+	printf("%10s %7s %8s %7s %7s %7s %6s %8s %6s %6s\n",
+		"frames", "fps", "jitter", "drops", "dqbuf", "proc",
+		"queue", "exposure", "gain", "skip");
+	for (;;) {
+		seq = shm_stats_read(s, &d);
+		if (seq != last)
+			printf("%10llu %7.2f %6.0fus %7llu %5uus %5uus %3u/%-2u"
+				" %8d %6d %5.1f%%\n",
+				(unsigned long long)d.frames, d.fps, d.jitter,
+				(unsigned long long)d.drops, d.dqbuf_us,
+				d.process_us, d.queued, d.n_buffers,
+				d.exposure, d.gain,
+				d.frames ? 100.0 * d.skipped / d.frames : 0.0);
+		last = seq;
+		fflush(stdout);
+		usleep(interval * 1000);
+	}
+	return 0;
+}
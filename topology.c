@@ -0,0 +1,149 @@
+/*
+ *  NUMA placement of capture buffers and workers
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#define _GNU_SOURCE		/* CPU_SET(), syscall() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#include <linux/mempolicy.h>
+
+#include "topology.h"
+
+#define SYSFS_NODE	"/sys/devices/system/node"
+
+static int read_int(const char *path, int *val)
+{
+	FILE *f = fopen(path, "r");
+	int r;
+
+	if (!f)
+		return -1;
+	r = fscanf(f, "%d", val);
+	fclose(f);
+	return 1 == r ? 0 : -1;
+}
+
+int topo_device_node(dev_t rdev)
+{
+	/* any directory realpath() returns, and the file name */
+	char path[PATH_MAX + sizeof("/numa_node")], dev[PATH_MAX], *slash;
+	int node;
+
+	snprintf(path, sizeof(path), "/sys/dev/char/%u:%u/device",
+		 major(rdev), minor(rdev));
+	if (!realpath(path, dev))
+		return -1;
+
+	/* uvc: usb interface -> usb device -> ... -> pci host controller */
+	while (strcmp(dev, "/sys/devices")) {
+		snprintf(path, sizeof(path), "%s/numa_node", dev);
+		if (!read_int(path, &node))
+			return node;	/* -1 if the platform does not know */
+		slash = strrchr(dev, '/');
+		if (!slash || slash == dev)
+			break;
+		*slash = '\0';
+	}
+	return -1;
+}
+
+int topo_nodes(void)
+{
+	char path[64];
+	int n = 0;
+
+	for (;;) {
+		snprintf(path, sizeof(path), SYSFS_NODE "/node%d", n);
+		if (access(path, F_OK))
+			break;
+		n++;
+	}
+	return n ? n : 1;
+}
+
+int topo_bind_node(int node)
+{
+	char path[64], list[1024], *s;
+	cpu_set_t set;
+	FILE *f;
+	int a, b, n;
+
+	if (node < 0)
+		return 0;
+
+	snprintf(path, sizeof(path), SYSFS_NODE "/node%d/cpulist", node);
+	f = fopen(path, "r");
+	if (!f || !fgets(list, sizeof(list), f)) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		if (f)
+			fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	/* "0-7,16-23" */
+	CPU_ZERO(&set);
+	for (s = list; *s && '\n' != *s; s += n) {
+		n = 0;
+		if (2 != sscanf(s, "%d-%d%n", &a, &b, &n)) {
+			if (1 != sscanf(s, "%d%n", &a, &n))
+				break;
+			b = a;
+		}
+		while (a <= b && a < CPU_SETSIZE)
+			CPU_SET(a++, &set);
+		if (',' == s[n])
+			n++;
+	}
+	if (!CPU_COUNT(&set))
+		return 0;	/* memory-only node */
+
+	if (-1 == sched_setaffinity(0, sizeof(set), &set)) {
+		fprintf(stderr, "binding to node %d error %d, %s\n",
+			node, errno, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+void *topo_alloc(size_t size, int node)
+{
+	unsigned long mask;
+	void *p;
+
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == p)
+		return NULL;
+
+	/*
+	 * Preferred rather than bound: a full node should still give us
+	 * memory. Errors (ENOSYS without CONFIG_NUMA) are not fatal either.
+	 */
+	if (node >= 0 && node < (int)(8 * sizeof(mask))) {
+		mask = 1UL << node;
+		syscall(SYS_mbind, p, size, MPOL_PREFERRED, &mask,
+			8 * sizeof(mask), 0);
+	}
+
+	memset(p, 0, size);
+	return p;
+}
+
+void topo_free(void *p, size_t size)
+{
+	if (p)
+		munmap(p, size);
+}
@@ -0,0 +1,39 @@
+/*
+ *  NUMA placement of capture buffers and workers
+ *
+ *  On a multi-socket machine the capture device hangs off the PCIe root
+ *  (or the USB host controller) of one socket. Buffers the device DMAs
+ *  into, and the threads that read them, belong on that node; sysfs
+ *  tells which one it is. Everything here degrades to "no preference"
+ *  (node -1) on single-node machines and kernels without NUMA.
+ */
+
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Node of the bus device behind the character device rdev, found by
+ * walking up /sys/dev/char/<major>:<minor>/device to the first parent
+ * with a numa_node attribute. Returns -1 if unknown.
+ */
+int topo_device_node(dev_t rdev);
+
+/* Number of NUMA nodes, at least 1. */
+int topo_nodes(void);
+
+/* Restrict the calling thread to the CPUs of node. Returns 0 or -1. */
+int topo_bind_node(int node);
+
+/*
+ * Page-aligned anonymous memory preferably on node (any node if -1),
+ * faulted in so that the placement is settled before capture starts.
+ * Release with topo_free().
+ */
+void *topo_alloc(size_t size, int node);
+
+void topo_free(void *p, size_t size);
+
+#endif /* TOPOLOGY_H */
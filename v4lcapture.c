@@ -0,0 +1,951 @@
+/*
+ *  V4L2 capture library
+ *	http://linuxtv.org/downloads/v4l-dvb-apis/capture-example.html
+ *  This program can be used and distributed without restrictions.
+ *
+ *      This program is provided with the V4L2 API
+ * see http://linuxtv.org/docs.php for more information
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>              /* low-level i/o */
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+
+#include "v4lcapture.h"
+#include "logring.h"
+#include "topology.h"
+#include "conv_plan.h"
+#include "bayer.h"
+
+#define pr_debug(cap, fmt, arg...) do {				\
+	if (LOGR_DEBUG <= LOGR_COMPILED_LEVEL && (cap)->verbose)	\
+		logring_write(LOGR_DEBUG, fmt, ##arg);			\
+} while (0)
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+static int errno_msg(const char *s)
+{
+	int err = errno;
+
+	fprintf(stderr, "%s error %d, %s\n", s, err, strerror(err));
+	errno = err;
+	return -1;
+}
+
+static int xioctl(int fh, int request, void *arg)
+{
+	int r;
+
+	do {
+		r = ioctl(fh, request, arg);
+	} while (-1 == r && EINTR == errno);
+
+	return r;
+}
+
+int v4lcap_open(struct v4lcap *cap, const char *dev_name, enum io_method io)
+{
+	struct stat st;
+	int verbose = cap->verbose;
+
+	CLEAR(*cap);
+	cap->dev_name = dev_name;
+	cap->io = io;
+	cap->fd = -1;
+	cap->node = -1;
+	cap->buf_count = V4LCAP_BUFFERS;
+	cap->verbose = verbose;
+
+	pr_debug(cap, "%s: called!\n", __func__);
+
+	if (-1 == stat(dev_name, &st)) {
+		fprintf(stderr, "Cannot identify '%s': %d, %s\n",
+			 dev_name, errno, strerror(errno));
+		return -1;
+	}
+
+	if (!S_ISCHR(st.st_mode)) {
+		fprintf(stderr, "%s is no device\n", dev_name);
+		errno = ENODEV;
+		return -1;
+	}
+
+	cap->node = topo_device_node(st.st_rdev);
+	pr_debug(cap, "%s: NUMA node %d\n", dev_name, cap->node);
+
+	cap->fd = open(dev_name, O_RDWR /* required */ | O_NONBLOCK, 0);
+
+	if (-1 == cap->fd) {
+		fprintf(stderr, "Cannot open '%s': %d, %s\n",
+			 dev_name, errno, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* 4:2:0 with the chroma in planes of half the luma size after it */
+static int planar_420(__u32 pixelformat)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_NV12:
+	case V4L2_PIX_FMT_NV21:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* bytes of an unpadded line (of luma if planar), 0 if not known */
+static unsigned int min_stride(const struct v4l2_pix_format *pix)
+{
+	const struct conv_format *f = conv_format_find(pix->pixelformat);
+
+	if (f)
+		return conv_format_stride(f, pix->width);
+	if (planar_420(pix->pixelformat))
+		return pix->width;
+	return bayer_min_stride(pix->pixelformat, pix->width);
+}
+
+int v4lcap_set_format(struct v4lcap *cap, const struct v4l2_pix_format *force)
+{
+	struct v4l2_capability cap_;
+	struct v4l2_cropcap cropcap;
+	struct v4l2_crop crop;
+	struct v4l2_format *fmt = &cap->fmt;
+	unsigned int min;
+
+	pr_debug(cap, "%s: called!\n", __func__);
+
+	if (-1 == xioctl(cap->fd, VIDIOC_QUERYCAP, &cap_)) {
+		if (EINVAL == errno) {
+			fprintf(stderr, "%s is no V4L2 device\n",
+				 cap->dev_name);
+			return -1;
+		} else {
+			return errno_msg("VIDIOC_QUERYCAP");
+		}
+	}
+
+	pr_debug(cap, "\tdriver: %s\n"
+		 "\tcard: %s \n"
+		 "\tbus_info: %s\n",
+			cap_.driver, cap_.card, cap_.bus_info);
+	pr_debug(cap, "\tversion: %u.%u.%u\n",
+			(cap_.version >> 16) & 0xFF,
+			(cap_.version >> 8) & 0xFF,
+			cap_.version & 0xFF);
+	pr_debug(cap, "\tcapabilities: 0x%08x\n", cap_.capabilities);
+
+	if (!(cap_.capabilities & V4L2_CAP_VIDEO_CAPTURE)) {
+		fprintf(stderr, "%s is no video capture device\n",
+			 cap->dev_name);
+		errno = EINVAL;
+		return -1;
+	}
+
+	switch (cap->io) {
+	case IO_METHOD_READ:
+		if (!(cap_.capabilities & V4L2_CAP_READWRITE)) {
+			fprintf(stderr, "%s does not support read i/o\n",
+				 cap->dev_name);
+			errno = EINVAL;
+			return -1;
+		}
+		break;
+
+	case IO_METHOD_MMAP:
+	case IO_METHOD_USERPTR:
+	case IO_METHOD_DMABUF:
+		if (!(cap_.capabilities & V4L2_CAP_STREAMING)) {
+			fprintf(stderr, "%s does not support streaming i/o\n",
+				 cap->dev_name);
+			errno = EINVAL;
+			return -1;
+		}
+		break;
+	}
+
+
+	/* Select video input, video standard and tune here. */
+
+
+	CLEAR(cropcap);
+
+	cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	if (0 == xioctl(cap->fd, VIDIOC_CROPCAP, &cropcap)) {
+		CLEAR(crop);
+		crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		crop.c = cropcap.defrect; /* reset to default */
+
+		if (-1 == xioctl(cap->fd, VIDIOC_S_CROP, &crop)) {
+			switch (errno) {
+			case EINVAL:
+				/* Cropping not supported. */
+				break;
+			default:
+				/* Errors ignored. */
+				pr_debug(cap, "\tcropping not supported\n");
+				break;
+			}
+		}
+	} else {
+		/* Errors ignored. */
+	}
+
+
+	CLEAR(*fmt);
+
+	fmt->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (force) {
+		fmt->fmt.pix.width       = force->width;
+		fmt->fmt.pix.height      = force->height;
+		fmt->fmt.pix.pixelformat = force->pixelformat;
+		fmt->fmt.pix.field       = force->field;
+
+		/*
+		This, VIDIOC_S_FMT, is one time setting, so you can NOT set twice.
+		You can't change the format while buffers are allocated.
+		You need to free the buffers before, using VIDIOC_REQBUFS with a buffer
+		count of 0.
+		*/
+		if (-1 == xioctl(cap->fd, VIDIOC_S_FMT, fmt))
+			return errno_msg("VIDIOC_S_FMT");
+
+		/* Note VIDIOC_S_FMT may change width and height. */
+	} else {
+		/* Preserve original settings as set by v4l2-ctl for example */
+		if (-1 == xioctl(cap->fd, VIDIOC_G_FMT, fmt))
+			return errno_msg("VIDIOC_G_FMT");
+	}
+
+	pr_debug(cap, "\tfmt.fmt.pix.pixelformat: %c,%c,%c,%c\n",
+			fmt->fmt.pix.pixelformat & 0xFF,
+			(fmt->fmt.pix.pixelformat >> 8) & 0xFF,
+			(fmt->fmt.pix.pixelformat >> 16) & 0xFF,
+			(fmt->fmt.pix.pixelformat >> 24) & 0xFF
+			);
+
+	/*
+	Buggy driver paranoia, for the formats whose layout we know: a
+	bytesperline larger than the one the driver uses would put every
+	line after the first at the wrong place.
+	*/
+	min = min_stride(&fmt->fmt.pix);
+	if (fmt->fmt.pix.bytesperline < min)
+		fmt->fmt.pix.bytesperline = min;
+	min = fmt->fmt.pix.bytesperline * fmt->fmt.pix.height;
+	if (planar_420(fmt->fmt.pix.pixelformat))
+		min += min / 2;
+	if (fmt->fmt.pix.sizeimage < min)
+		fmt->fmt.pix.sizeimage = min;
+
+	return 0;
+}
+
+static int init_read(struct v4lcap *cap, unsigned int buffer_size)
+{
+	pr_debug(cap, "%s: called!\n", __func__);
+
+	cap->buffers = calloc(1, sizeof(*cap->buffers));
+
+	if (!cap->buffers) {
+		fprintf(stderr, "Out of memory\n");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	cap->buffers[0].length = buffer_size;
+	cap->buffers[0].start = malloc(buffer_size);
+
+	if (!cap->buffers[0].start) {
+		fprintf(stderr, "Out of memory\n");
+		errno = ENOMEM;
+		return -1;
+	}
+	cap->n_buffers = 1;
+	return 0;
+}
+
+static int queue_buffer(struct v4lcap *cap, unsigned int i)
+{
+	struct v4l2_buffer buf;
+
+	CLEAR(buf);
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.index = i;
+	if (IO_METHOD_USERPTR == cap->io) {
+		buf.memory = V4L2_MEMORY_USERPTR;
+		buf.m.userptr = (unsigned long)cap->buffers[i].start;
+		buf.length = cap->buffers[i].length;
+	} else if (IO_METHOD_DMABUF == cap->io) {
+		buf.memory = V4L2_MEMORY_DMABUF;
+		buf.m.fd = cap->buffers[i].fd;
+	} else {
+		buf.memory = V4L2_MEMORY_MMAP;
+	}
+
+	if (-1 == xioctl(cap->fd, VIDIOC_QBUF, &buf))
+		return errno_msg("VIDIOC_QBUF");
+	__atomic_add_fetch(&cap->queued, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* look up buffer i of an mmap queue and map it */
+static int map_buffer(struct v4lcap *cap, unsigned int i)
+{
+	struct v4l2_buffer buf;
+
+	CLEAR(buf);
+
+	buf.type        = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory      = V4L2_MEMORY_MMAP;
+	buf.index       = i;
+
+	if (-1 == xioctl(cap->fd, VIDIOC_QUERYBUF, &buf))
+		return errno_msg("VIDIOC_QUERYBUF");
+
+	pr_debug(cap, "\tbuf.index: %d\n", buf.index);
+	pr_debug(cap, "\tbuf.m.offset: %d\n", buf.m.offset);
+	pr_debug(cap, "\tbuf.length: %d\n", buf.length);
+
+	cap->buffers[i].length = buf.length;
+	cap->buffers[i].start =
+		mmap(NULL /* start anywhere */,
+		      buf.length,
+		      PROT_READ | PROT_WRITE /* required */,
+		      MAP_SHARED /* recommended */,
+		      cap->fd, buf.m.offset);
+
+	if (MAP_FAILED == cap->buffers[i].start) {
+		cap->buffers[i].start = NULL;
+		return errno_msg("mmap");
+	}
+	__atomic_add_fetch(&cap->grow.bytes, buf.length, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* a count 0 VIDIOC_CREATE_BUFS only checks that the driver has it */
+static void probe_growth(struct v4lcap *cap)
+{
+	struct v4l2_create_buffers create;
+
+	CLEAR(create);
+	create.count = 0;
+	create.memory = V4L2_MEMORY_MMAP;
+	create.format = cap->fmt;
+
+	if (-1 == xioctl(cap->fd, VIDIOC_CREATE_BUFS, &create)) {
+		fprintf(stderr, "%s cannot add buffers while streaming, "
+			"the queue stays at %u\n", cap->dev_name,
+			cap->n_buffers);
+		cap->grow.max = 0;
+	}
+}
+
+static int init_mmap(struct v4lcap *cap)
+{
+	struct v4l2_requestbuffers req;
+	unsigned int slots;
+
+	pr_debug(cap, "%s: called!\n", __func__);
+
+	CLEAR(req);
+
+	req.count = cap->buf_count;
+	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_MMAP;
+
+	if (-1 == xioctl(cap->fd, VIDIOC_REQBUFS, &req)) {
+		if (EINVAL == errno) {
+			fprintf(stderr, "%s does not support "
+				 "memory mapping\n", cap->dev_name);
+			return -1;
+		} else {
+			return errno_msg("VIDIOC_REQBUFS");
+		}
+	}
+	pr_debug(cap, "\treq.count: %d\n", req.count);
+
+	if (req.count < 2) {
+		fprintf(stderr, "Insufficient buffer memory on %s\n",
+			 cap->dev_name);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/* a growing queue gets all its slots now, nothing moves later */
+	slots = cap->grow.max ? VIDEO_MAX_FRAME : req.count;
+	cap->buffers = calloc(slots, sizeof(*cap->buffers));
+
+	if (!cap->buffers) {
+		fprintf(stderr, "Out of memory\n");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (cap->n_buffers = 0; cap->n_buffers < req.count; ++cap->n_buffers)
+		if (map_buffer(cap, cap->n_buffers))
+			return -1;
+
+	cap->grow.base = req.count;
+	if (cap->grow.max)
+		probe_growth(cap);
+	return 0;
+}
+
+/* take one pending park request, if there is one */
+static int take_park(struct v4lcap_growth *g)
+{
+	unsigned int n = __atomic_load_n(&g->park, __ATOMIC_RELAXED);
+
+	while (n)
+		if (__atomic_compare_exchange_n(&g->park, &n, n - 1, 0,
+						__ATOMIC_RELAXED,
+						__ATOMIC_RELAXED))
+			return 1;
+	return 0;
+}
+
+/*
+ * Put n more buffers into the queue: cancel pending parks, requeue
+ * parked buffers, then create new ones within the memory cap. A driver
+ * that refuses is reported once and growth stops; capture goes on.
+ */
+static int grow(struct v4lcap *cap, unsigned int n)
+{
+	struct v4lcap_growth *g = &cap->grow;
+	struct v4l2_create_buffers create;
+	size_t size = cap->fmt.fmt.pix.sizeimage;
+	size_t bytes;
+	unsigned int i, live = 0;
+
+	for (; n && take_park(g); n--)
+		g->extra++;
+
+	for (i = g->base; i < cap->n_buffers && n; i++) {
+		if (!__atomic_load_n(&cap->buffers[i].parked, __ATOMIC_ACQUIRE))
+			continue;
+		__atomic_store_n(&cap->buffers[i].parked, 0, __ATOMIC_RELAXED);
+		if (queue_buffer(cap, i))
+			return -1;
+		g->extra++;
+		g->unparked++;
+		n--;
+	}
+
+	bytes = __atomic_load_n(&g->bytes, __ATOMIC_RELAXED);
+	if (bytes + size > g->max)
+		return 0;
+	if (n > (g->max - bytes) / size)
+		n = (g->max - bytes) / size;
+	/* parked buffers still hold a slot */
+	for (i = 0; i < cap->n_buffers; i++)
+		if (cap->buffers[i].start)
+			live++;
+	if (n > VIDEO_MAX_FRAME - live)
+		n = VIDEO_MAX_FRAME - live;
+	if (!n)
+		return 0;
+
+	CLEAR(create);
+	create.count = n;
+	create.memory = V4L2_MEMORY_MMAP;
+	create.format = cap->fmt;
+
+	if (-1 == xioctl(cap->fd, VIDIOC_CREATE_BUFS, &create) ||
+	    create.index + create.count > VIDEO_MAX_FRAME) {
+		errno_msg("VIDIOC_CREATE_BUFS");
+		g->max = 0;
+		return 0;
+	}
+	pr_debug(cap, "%s: %u buffers from %u\n", __func__, create.count,
+		 create.index);
+
+	for (i = create.index; i < create.index + create.count; i++) {
+		if (map_buffer(cap, i)) {
+			g->max = 0;
+			return 0;
+		}
+		if (i >= cap->n_buffers)
+			cap->n_buffers = i + 1;
+		if (queue_buffer(cap, i))
+			return -1;
+		g->extra++;
+		g->created++;
+	}
+	return 0;
+}
+
+/*
+ * Called for every buffer dequeued from a growing queue: a sequence gap
+ * or a driver left without buffers grows the queue, a quiet period
+ * shrinks it by one.
+ */
+static int watch_queue(struct v4lcap *cap, const struct v4l2_buffer *buf)
+{
+	struct v4lcap_growth *g = &cap->grow;
+	int lost = 0, starved;
+
+	if (g->seq_valid)
+		lost = (int)(buf->sequence - g->last_seq - 1);
+	/* the sequence restarts with the stream */
+	if (lost < 0)
+		lost = 0;
+	g->last_seq = buf->sequence;
+	g->seq_valid = 1;
+	starved = !__atomic_load_n(&cap->queued, __ATOMIC_RELAXED);
+
+	if (lost || starved) {
+		g->lost += lost;
+		g->starved += starved;
+		g->quiet = 0;
+		return grow(cap, lost > V4LCAP_GROW_STEP ? V4LCAP_GROW_STEP :
+				 lost ? lost : 1);
+	}
+
+	if (++g->quiet >= V4LCAP_QUIET_FRAMES) {
+		g->quiet = 0;
+		if (g->extra) {
+			g->extra--;
+			__atomic_add_fetch(&g->park, 1, __ATOMIC_RELAXED);
+		}
+	}
+	return 0;
+}
+
+/* take a grown buffer out of the queue instead of requeueing it */
+static void park_buffer(struct v4lcap *cap, unsigned int i)
+{
+	struct buffer *b = &cap->buffers[i];
+#ifdef VIDIOC_REMOVE_BUFS
+	struct v4l2_remove_buffers remove;
+
+	/* unmapped first: the slot may be handed out again right away */
+	munmap(b->start, b->length);
+	b->start = NULL;
+	__atomic_sub_fetch(&cap->grow.bytes, b->length, __ATOMIC_RELAXED);
+
+	CLEAR(remove);
+	remove.index = i;
+	remove.count = 1;
+	remove.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (-1 == xioctl(cap->fd, VIDIOC_REMOVE_BUFS, &remove))
+		errno_msg("VIDIOC_REMOVE_BUFS");
+	__atomic_add_fetch(&cap->grow.removed, 1, __ATOMIC_RELAXED);
+#else
+	__atomic_store_n(&b->parked, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&cap->grow.parked, 1, __ATOMIC_RELAXED);
+#endif
+	pr_debug(cap, "%s: buffer %u\n", __func__, i);
+}
+
+int v4lcap_set_growth(struct v4lcap *cap, size_t max_bytes)
+{
+	if (IO_METHOD_MMAP != cap->io) {
+		fprintf(stderr, "%s: only mmap buffers can be added\n",
+			cap->dev_name);
+		errno = EINVAL;
+		return -1;
+	}
+	cap->grow.max = max_bytes;
+	return 0;
+}
+
+static int init_userp(struct v4lcap *cap, unsigned int buffer_size)
+{
+	struct v4l2_requestbuffers req;
+
+	pr_debug(cap, "%s: called!\n", __func__);
+
+	CLEAR(req);
+
+	req.count  = cap->buf_count;
+	req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_USERPTR;
+
+	if (-1 == xioctl(cap->fd, VIDIOC_REQBUFS, &req)) {
+		if (EINVAL == errno) {
+			fprintf(stderr, "%s does not support "
+				 "user pointer i/o\n", cap->dev_name);
+			return -1;
+		} else {
+			return errno_msg("VIDIOC_REQBUFS");
+		}
+	}
+
+	cap->buffers = calloc(cap->buf_count, sizeof(*cap->buffers));
+
+	if (!cap->buffers) {
+		fprintf(stderr, "Out of memory\n");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (cap->n_buffers = 0; cap->n_buffers < cap->buf_count;
+	     ++cap->n_buffers) {
+		cap->buffers[cap->n_buffers].length = buffer_size;
+		cap->buffers[cap->n_buffers].start =
+			topo_alloc(buffer_size, cap->node);
+
+		if (!cap->buffers[cap->n_buffers].start) {
+			fprintf(stderr, "Out of memory\n");
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int init_dmabuf(struct v4lcap *cap, unsigned int buffer_size)
+{
+	struct v4l2_requestbuffers req;
+	struct dma_heap_allocation_data alloc;
+	long page = sysconf(_SC_PAGESIZE);
+	struct buffer *b;
+	int heap;
+
+	pr_debug(cap, "%s: called!\n", __func__);
+
+	CLEAR(req);
+
+	req.count  = cap->buf_count;
+	req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	req.memory = V4L2_MEMORY_DMABUF;
+
+	if (-1 == xioctl(cap->fd, VIDIOC_REQBUFS, &req)) {
+		if (EINVAL == errno) {
+			fprintf(stderr, "%s does not support "
+				 "dmabuf i/o\n", cap->dev_name);
+			return -1;
+		} else {
+			return errno_msg("VIDIOC_REQBUFS");
+		}
+	}
+
+	heap = open(V4LCAP_DMA_HEAP, O_RDWR | O_CLOEXEC);
+	if (-1 == heap)
+		return errno_msg(V4LCAP_DMA_HEAP);
+
+	cap->buffers = calloc(cap->buf_count, sizeof(*cap->buffers));
+
+	if (!cap->buffers) {
+		close(heap);
+		fprintf(stderr, "Out of memory\n");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	buffer_size = (buffer_size + page - 1) & ~(page - 1);
+	for (cap->n_buffers = 0; cap->n_buffers < cap->buf_count;
+	     ++cap->n_buffers) {
+		b = &cap->buffers[cap->n_buffers];
+
+		CLEAR(alloc);
+		alloc.len = buffer_size;
+		alloc.fd_flags = O_RDWR | O_CLOEXEC;
+		if (-1 == xioctl(heap, DMA_HEAP_IOCTL_ALLOC, &alloc)) {
+			close(heap);
+			return errno_msg("DMA_HEAP_IOCTL_ALLOC");
+		}
+		b->fd = alloc.fd;
+		b->length = buffer_size;
+		b->start = mmap(NULL, buffer_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, b->fd, 0);
+		if (MAP_FAILED == b->start) {
+			b->start = NULL;
+			close(heap);
+			/* counted so that close() releases the fd */
+			++cap->n_buffers;
+			return errno_msg("mmap dmabuf");
+		}
+	}
+	close(heap);
+	return 0;
+}
+
+/* CPU access to a dmabuf is bracketed for cache maintenance */
+static int dmabuf_sync(struct v4lcap *cap, unsigned int i, uint64_t flags)
+{
+	struct dma_buf_sync sync;
+
+	sync.flags = flags | DMA_BUF_SYNC_READ;
+	if (-1 == xioctl(cap->buffers[i].fd, DMA_BUF_IOCTL_SYNC, &sync))
+		return errno_msg("DMA_BUF_IOCTL_SYNC");
+	return 0;
+}
+
+int v4lcap_init_buffers(struct v4lcap *cap)
+{
+	switch (cap->io) {
+	case IO_METHOD_READ:
+		return init_read(cap, cap->fmt.fmt.pix.sizeimage);
+
+	case IO_METHOD_MMAP:
+		return init_mmap(cap);
+
+	case IO_METHOD_USERPTR:
+		return init_userp(cap, cap->fmt.fmt.pix.sizeimage);
+
+	case IO_METHOD_DMABUF:
+		return init_dmabuf(cap, cap->fmt.fmt.pix.sizeimage);
+	}
+	return 0;
+}
+
+int v4lcap_start(struct v4lcap *cap)
+{
+	unsigned int i;
+	enum v4l2_buf_type type;
+
+	pr_debug(cap, "%s: called!\n", __func__);
+
+	pr_debug(cap, "\tn_buffers: %d\n", cap->n_buffers);
+
+	switch (cap->io) {
+	case IO_METHOD_READ:
+		/* Nothing to do. */
+		break;
+
+	case IO_METHOD_MMAP:
+	case IO_METHOD_USERPTR:
+	case IO_METHOD_DMABUF:
+		for (i = 0; i < cap->n_buffers; ++i) {
+			/* removed from a grown queue */
+			if (IO_METHOD_MMAP == cap->io && !cap->buffers[i].start)
+				continue;
+			cap->buffers[i].parked = 0;
+			if (queue_buffer(cap, i))
+				return -1;
+		}
+		cap->grow.extra = cap->n_buffers - cap->grow.base;
+		for (i = cap->grow.base; i < cap->n_buffers; i++)
+			if (!cap->buffers[i].start)
+				cap->grow.extra--;
+		cap->grow.park = 0;
+		cap->grow.seq_valid = 0;
+
+		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if (-1 == xioctl(cap->fd, VIDIOC_STREAMON, &type))
+			return errno_msg("VIDIOC_STREAMON");
+		break;
+	}
+	return 0;
+}
+
+int v4lcap_dequeue(struct v4lcap *cap, struct v4lcap_frame *frame)
+{
+	struct v4l2_buffer *buf = &frame->buf;
+	unsigned int i;
+	ssize_t r;
+
+	CLEAR(*frame);
+
+	switch (cap->io) {
+	case IO_METHOD_READ:
+		r = read(cap->fd, cap->buffers[0].start, cap->buffers[0].length);
+		if (-1 == r) {
+			switch (errno) {
+			case EAGAIN:
+				return 0;
+
+			case EIO:
+				/* Could ignore EIO, see spec. */
+
+				/* fall through */
+
+			default:
+				return errno_msg("read");
+			}
+		}
+
+		frame->start = cap->buffers[0].start;
+		frame->bytesused = r;
+		break;
+
+	case IO_METHOD_MMAP:
+	case IO_METHOD_USERPTR:
+	case IO_METHOD_DMABUF:
+		buf->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf->memory = IO_METHOD_MMAP == cap->io ? V4L2_MEMORY_MMAP :
+			      IO_METHOD_DMABUF == cap->io ? V4L2_MEMORY_DMABUF
+							  : V4L2_MEMORY_USERPTR;
+
+		if (-1 == xioctl(cap->fd, VIDIOC_DQBUF, buf)) {
+			switch (errno) {
+			case EAGAIN:
+				return 0;
+
+			case EIO:
+				/* Could ignore EIO, see spec. */
+
+				/* fall through */
+
+			default:
+				return errno_msg("VIDIOC_DQBUF");
+			}
+		}
+		__atomic_sub_fetch(&cap->queued, 1, __ATOMIC_RELAXED);
+
+		if (IO_METHOD_USERPTR != cap->io) {
+			if (buf->index >= cap->n_buffers) {
+				errno = EINVAL;
+				return errno_msg("VIDIOC_DQBUF index");
+			}
+			frame->start = cap->buffers[buf->index].start;
+			if (IO_METHOD_DMABUF == cap->io &&
+			    dmabuf_sync(cap, buf->index, DMA_BUF_SYNC_START))
+				return -1;
+			if (cap->grow.max && watch_queue(cap, buf))
+				return -1;
+		} else {
+			for (i = 0; i < cap->n_buffers; ++i)
+				if (buf->m.userptr == (unsigned long)cap->buffers[i].start
+				    && buf->length == cap->buffers[i].length)
+					break;
+			if (i >= cap->n_buffers) {
+				errno = EINVAL;
+				return errno_msg("VIDIOC_DQBUF userptr");
+			}
+			frame->start = (void *)buf->m.userptr;
+		}
+		frame->bytesused = buf->bytesused;
+		break;
+	}
+
+	return 1;
+}
+
+int v4lcap_dequeue_latest(struct v4lcap *cap, struct v4lcap_frame *frame,
+			  unsigned long *skipped)
+{
+	struct v4lcap_frame next;
+	int r;
+
+	r = v4lcap_dequeue(cap, frame);
+	/* read() has nothing queued behind the frame it returned */
+	if (1 != r || IO_METHOD_READ == cap->io)
+		return r;
+
+	for (;;) {
+		r = v4lcap_dequeue(cap, &next);
+		if (-1 == r)
+			return -1;
+		if (0 == r)
+			return 1;
+		if (v4lcap_requeue(cap, frame))
+			return -1;
+		(*skipped)++;
+		*frame = next;
+	}
+}
+
+int v4lcap_requeue(struct v4lcap *cap, struct v4lcap_frame *frame)
+{
+	if (IO_METHOD_READ == cap->io)
+		return 0;
+
+	if (IO_METHOD_DMABUF == cap->io) {
+		if (dmabuf_sync(cap, frame->buf.index, DMA_BUF_SYNC_END))
+			return -1;
+		frame->buf.m.fd = cap->buffers[frame->buf.index].fd;
+	}
+
+	if (IO_METHOD_MMAP == cap->io && frame->buf.index >= cap->grow.base &&
+	    take_park(&cap->grow)) {
+		park_buffer(cap, frame->buf.index);
+		return 0;
+	}
+
+	if (-1 == xioctl(cap->fd, VIDIOC_QBUF, &frame->buf))
+		return errno_msg("VIDIOC_QBUF");
+	__atomic_add_fetch(&cap->queued, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int v4lcap_stop(struct v4lcap *cap)
+{
+	enum v4l2_buf_type type;
+
+	pr_debug(cap, "%s: called!\n", __func__);
+
+	switch (cap->io) {
+	case IO_METHOD_READ:
+		/* Nothing to do. */
+		break;
+
+	case IO_METHOD_MMAP:
+	case IO_METHOD_USERPTR:
+	case IO_METHOD_DMABUF:
+		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if (-1 == xioctl(cap->fd, VIDIOC_STREAMOFF, &type))
+			return errno_msg("VIDIOC_STREAMOFF");
+		cap->queued = 0;
+		break;
+	}
+	return 0;
+}
+
+int v4lcap_close(struct v4lcap *cap)
+{
+	unsigned int i;
+	int ret = 0;
+
+	pr_debug(cap, "%s: called!\n", __func__);
+
+	if (cap->buffers) {
+		switch (cap->io) {
+		case IO_METHOD_READ:
+			free(cap->buffers[0].start);
+			break;
+
+		case IO_METHOD_MMAP:
+			for (i = 0; i < cap->n_buffers; ++i)
+				if (cap->buffers[i].start &&
+				    -1 == munmap(cap->buffers[i].start,
+						 cap->buffers[i].length))
+					ret = errno_msg("munmap");
+			break;
+
+		case IO_METHOD_USERPTR:
+			for (i = 0; i < cap->n_buffers; ++i)
+				topo_free(cap->buffers[i].start,
+					  cap->buffers[i].length);
+			break;
+
+		case IO_METHOD_DMABUF:
+			for (i = 0; i < cap->n_buffers; ++i) {
+				if (cap->buffers[i].start)
+					munmap(cap->buffers[i].start,
+					       cap->buffers[i].length);
+				close(cap->buffers[i].fd);
+			}
+			break;
+		}
+
+		free(cap->buffers);
+		cap->buffers = NULL;
+		cap->n_buffers = 0;
+	}
+
+	if (-1 != cap->fd && -1 == close(cap->fd))
+		ret = errno_msg("close");
+
+	cap->fd = -1;
+	return ret;
+}
@@ -0,0 +1,143 @@
+/*
+ *  V4L2 capture library
+ *
+ *  The capture state machine of the V4L2 capture example, with all state
+ *  kept in a per-device context so one process can drive several
+ *  cameras:
+ *
+ *	v4lcap_open()		open the device node
+ *	v4lcap_set_format()	negotiate the format
+ *	v4lcap_init_buffers()	allocate read/mmap/userptr/dmabuf buffers
+ *	v4lcap_start()		queue all buffers, STREAMON
+ *	v4lcap_dequeue()	take a filled buffer (non-blocking)
+ *	v4lcap_dequeue_latest()	or only the newest of those ready
+ *	v4lcap_requeue()	give it back to the driver
+ *	v4lcap_stop()		STREAMOFF
+ *	v4lcap_close()		free buffers, close the device
+ *
+ *  Errors are reported on stderr and returned as -1 with errno set; the
+ *  caller decides whether to give up.
+ */
+
+#ifndef V4LCAPTURE_H
+#define V4LCAPTURE_H
+
+#include <stddef.h>
+#include <linux/videodev2.h>
+
+#define V4LCAP_BUFFERS	4	/* buffers requested by default */
+#define V4LCAP_GROW_STEP	4	/* buffers added for one gap, at most */
+#define V4LCAP_QUIET_FRAMES	300	/* without a drop before one is parked */
+
+enum io_method {
+	IO_METHOD_READ,
+	IO_METHOD_MMAP,
+	IO_METHOD_USERPTR,
+	IO_METHOD_DMABUF,	/* imported from V4LCAP_DMA_HEAP */
+};
+
+/* exporter of the buffers for IO_METHOD_DMABUF */
+#define V4LCAP_DMA_HEAP	"/dev/dma_heap/system"
+
+struct buffer {
+	void   *start;
+	size_t  length;
+	int     fd;	/* dmabuf */
+	int     parked;	/* grown, now out of the queue; atomic */
+};
+
+/*
+ * Queue growth, see v4lcap_set_growth(). Watched by the dequeueing
+ * thread; park and the counters of parked buffers are also changed by
+ * v4lcap_requeue(), which may run elsewhere.
+ */
+struct v4lcap_growth {
+	size_t			max;		/* bytes of buffers, 0 = fixed */
+	size_t			bytes;		/* mapped now, atomic */
+	unsigned int		base;		/* from REQBUFS, never shrunk */
+	unsigned int		extra;		/* grown buffers in the queue */
+	unsigned int		park;		/* to take out on requeue, atomic */
+	unsigned int		last_seq;
+	int			seq_valid;
+	unsigned int		quiet;		/* frames since the last drop */
+
+	unsigned long		lost;		/* sequence numbers skipped */
+	unsigned long		starved;	/* dequeues that emptied the queue */
+	unsigned long		created;	/* by VIDIOC_CREATE_BUFS */
+	unsigned long		unparked;
+	unsigned long		parked;		/* atomic */
+	unsigned long		removed;	/* by VIDIOC_REMOVE_BUFS, atomic */
+};
+
+struct v4lcap {
+	const char		*dev_name;
+	enum io_method		io;
+	int			fd;
+	struct buffer		*buffers;
+	unsigned int		n_buffers;
+	unsigned int		buf_count;	/* to request, V4LCAP_BUFFERS */
+	unsigned int		queued;		/* buffers owned by the driver, atomic */
+	struct v4l2_format	fmt;		/* as negotiated */
+	int			node;		/* NUMA node of the device, -1 */
+	int			verbose;
+	struct v4lcap_growth	grow;
+};
+
+struct frame_stats;
+
+/* one dequeued buffer, valid until v4lcap_requeue() */
+struct v4lcap_frame {
+	void			*start;
+	size_t			bytesused;
+	struct v4l2_buffer	buf;	/* index, sequence, timestamp, ... */
+	/* set by whoever converted the frame, see conv_plan_run() */
+	const struct frame_stats *stats;
+};
+
+/*
+ * cap->verbose may be set before, everything else is reset. cap->node is
+ * looked up in sysfs; userptr buffers are allocated there.
+ */
+int v4lcap_open(struct v4lcap *cap, const char *dev_name, enum io_method io);
+
+/*
+ * force: format to set with VIDIOC_S_FMT (it may be adjusted by the
+ * driver), or NULL to keep what is set, e.g. by v4l2-ctl.
+ */
+int v4lcap_set_format(struct v4lcap *cap, const struct v4l2_pix_format *force);
+
+/*
+ * Let an mmap queue grow while streaming, between v4lcap_open() and
+ * v4lcap_init_buffers(). When a dequeued frame shows a sequence gap, or
+ * leaves the driver without a buffer to fill, buffers are added with
+ * VIDIOC_CREATE_BUFS, mapped and queued, until they take max_bytes. After
+ * V4LCAP_QUIET_FRAMES without a drop one grown buffer is parked on its
+ * next requeue: kept out of the queue and reused first by the next
+ * growth. Kernels with VIDIOC_REMOVE_BUFS free it instead. Drivers
+ * without VIDIOC_CREATE_BUFS keep the fixed queue.
+ */
+int v4lcap_set_growth(struct v4lcap *cap, size_t max_bytes);
+
+int v4lcap_init_buffers(struct v4lcap *cap);
+
+int v4lcap_start(struct v4lcap *cap);
+
+/* Returns 1 and a frame, 0 if none is ready (EAGAIN), -1 on error. */
+int v4lcap_dequeue(struct v4lcap *cap, struct v4lcap_frame *frame);
+
+/*
+ * v4lcap_dequeue() for a consumer that only wants the newest frame:
+ * takes every buffer that is ready and requeues all but the last, so a
+ * slow consumer never works through a backlog. *skipped is increased
+ * by the number requeued unseen.
+ */
+int v4lcap_dequeue_latest(struct v4lcap *cap, struct v4lcap_frame *frame,
+			  unsigned long *skipped);
+
+int v4lcap_requeue(struct v4lcap *cap, struct v4lcap_frame *frame);
+
+int v4lcap_stop(struct v4lcap *cap);
+
+int v4lcap_close(struct v4lcap *cap);
+
+#endif /* V4LCAPTURE_H */
@@ -0,0 +1,255 @@
+/*
+ *  YUV4MPEG2 output
+ *
+ *  This program can be used and distributed without restrictions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "y4m.h"
+#include "convert.h"
+
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+static char frame_tag[] = "FRAME\n";
+
+static int errno_msg(const char *s)
+{
+	int err = errno;
+
+	fprintf(stderr, "%s error %d, %s\n", s, err, strerror(err));
+	errno = err;
+	return -1;
+}
+
+int y4m_supported(unsigned int pixelformat)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_YUYV:
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_GREY:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static const char *interlacing(unsigned int field)
+{
+	switch (field) {
+	case V4L2_FIELD_INTERLACED:
+	case V4L2_FIELD_INTERLACED_TB:
+		return "It";
+	case V4L2_FIELD_INTERLACED_BT:
+		return "Ib";
+	default:
+		return "Ip";
+	}
+}
+
+/*
+ * The siting of what y4m_write() produces: yuyv_to_i420() puts chroma
+ * midway between the lines it averages, within a field for interlaced
+ * input, which with It/Ib is what C420mpeg2 means. Planar 4:2:0 from
+ * the driver is passed as it is; V4L2 leaves its siting open, MPEG-2 is
+ * the usual.
+ */
+static const char *chroma_tag(const struct y4m_writer *w)
+{
+	return V4L2_PIX_FMT_GREY == w->pixelformat ? "Cmono" : "C420mpeg2";
+}
+
+static const char *range(const struct v4l2_pix_format *pix)
+{
+	unsigned int quant = pix->quantization;
+
+	if (V4L2_QUANTIZATION_DEFAULT == quant)
+		quant = V4L2_MAP_QUANTIZATION_DEFAULT(0, pix->colorspace,
+			V4L2_MAP_YCBCR_ENC_DEFAULT(pix->colorspace));
+	return V4L2_QUANTIZATION_FULL_RANGE == quant ? "FULL" : "LIMITED";
+}
+
+static int write_all(int fd, const char *p, size_t n)
+{
+	ssize_t r;
+
+	while (n) {
+		r = write(fd, p, n);
+		if (-1 == r) {
+			if (EINTR == errno)
+				continue;
+			return errno_msg("write");
+		}
+		p += r;
+		n -= r;
+	}
+	return 0;
+}
+
+int y4m_open(struct y4m_writer *w, int fd, const struct v4l2_format *fmt,
+	     const struct v4l2_fract *tpf, unsigned int batch)
+{
+	const struct v4l2_pix_format *pix = &fmt->fmt.pix;
+	unsigned int num = 30, den = 1;
+	size_t chroma;
+	char hdr[160];
+	int n;
+
+	CLEAR(*w);
+	if (!y4m_supported(pix->pixelformat)) {
+		fprintf(stderr, "no Y4M layout for %.4s\n",
+			(const char *)&pix->pixelformat);
+		errno = EINVAL;
+		return -1;
+	}
+
+	w->fd = fd;
+	w->width = pix->width;
+	w->height = pix->height;
+	w->pixelformat = pix->pixelformat;
+	w->src_stride = pix->bytesperline;
+	w->interlaced = 'I' == interlacing(pix->field)[0];
+	chroma = (size_t)((w->width + 1) / 2) * ((w->height + 1) / 2);
+	w->frame_size = (size_t)w->width * w->height;
+	if (V4L2_PIX_FMT_GREY != w->pixelformat)
+		w->frame_size += 2 * chroma;
+
+	w->batch = batch < 1 ? 1 : batch > Y4M_BATCH_MAX ? Y4M_BATCH_MAX : batch;
+	w->slots = malloc(w->batch * w->frame_size);
+	if (!w->slots) {
+		fprintf(stderr, "Out of memory\n");
+		errno = ENOMEM;
+		return -1;
+	}
+
+	/* Y4M gives frames per second, V4L2 seconds per frame */
+	if (tpf->numerator && tpf->denominator) {
+		num = tpf->denominator;
+		den = tpf->numerator;
+	}
+	n = snprintf(hdr, sizeof(hdr), "YUV4MPEG2 W%u H%u F%u:%u %s A1:1 %s "
+		     "XCOLORRANGE=%s\n", w->width, w->height, num, den,
+		     interlacing(pix->field),
+		     chroma_tag(w),
+		     range(pix));
+	if (write_all(fd, hdr, n)) {
+		free(w->slots);
+		w->slots = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/* writev() everything pending, however many calls it takes */
+static int flush(struct y4m_writer *w)
+{
+	struct iovec *iov = w->iov;
+	int n = 2 * w->pending;
+	ssize_t r;
+
+	while (n) {
+		r = writev(w->fd, iov, n);
+		if (-1 == r) {
+			if (EINTR == errno)
+				continue;
+			return errno_msg("writev");
+		}
+		w->writes++;
+		while (n && (size_t)r >= iov->iov_len) {
+			r -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n) {
+			iov->iov_base = (char *)iov->iov_base + r;
+			iov->iov_len -= r;
+		}
+	}
+	w->pending = 0;
+	return 0;
+}
+
+/* could the consumer take more right now? */
+static int writable(int fd)
+{
+	struct pollfd pfd = { fd, POLLOUT, 0 };
+
+	return poll(&pfd, 1, 0) != 0;
+}
+
+int y4m_write(struct y4m_writer *w, const void *data, size_t size)
+{
+	unsigned char *slot = w->slots + w->pending * w->frame_size;
+	unsigned char *d = slot;
+	const unsigned char *s = data;
+	size_t luma = (size_t)w->width * w->height;
+	size_t chroma = (w->frame_size - luma) / 2;
+	unsigned int l;
+
+	switch (w->pixelformat) {
+	case V4L2_PIX_FMT_YUYV:
+		if (size < (size_t)w->src_stride * (w->height - 1) + w->width * 2)
+			goto short_frame;
+		yuyv_to_i420(w->width, w->height, s, w->src_stride,
+			     w->interlaced, d, d + luma, d + luma + chroma);
+		break;
+
+	case V4L2_PIX_FMT_GREY:
+		if (size < (size_t)w->src_stride * (w->height - 1) + w->width)
+			goto short_frame;
+		for (l = 0; l < w->height; l++)
+			memcpy(d + l * w->width, s + l * w->src_stride, w->width);
+		break;
+
+	default:
+		/* chroma planes have half the luma bytesperline */
+		if (size < (size_t)w->src_stride * w->height * 3 / 2)
+			goto short_frame;
+		if (w->src_stride == w->width) {
+			memcpy(d, s, w->frame_size);
+			break;
+		}
+		for (l = 0; l < w->height; l++)
+			memcpy(d + l * w->width, s + l * w->src_stride, w->width);
+		s += (size_t)w->src_stride * w->height;
+		d += luma;
+		for (l = 0; l < 2 * ((w->height + 1) / 2); l++)
+			memcpy(d + l * ((w->width + 1) / 2),
+			       s + l * (w->src_stride / 2), (w->width + 1) / 2);
+		break;
+	}
+
+	w->iov[2 * w->pending].iov_base = frame_tag;
+	w->iov[2 * w->pending].iov_len = sizeof(frame_tag) - 1;
+	w->iov[2 * w->pending + 1].iov_base = slot;
+	w->iov[2 * w->pending + 1].iov_len = w->frame_size;
+	w->pending++;
+	w->frames++;
+	if (w->pending > w->max_pending)
+		w->max_pending = w->pending;
+
+	/* a consumer that is behind gets the frames in one go later */
+	if (w->pending < w->batch && !writable(w->fd))
+		return 0;
+	return flush(w);
+
+short_frame:
+	fprintf(stderr, "short frame, %zu bytes, not written\n", size);
+	return 0;
+}
+
+int y4m_close(struct y4m_writer *w)
+{
+	int r = 0;
+
+	if (w->pending)
+		r = flush(w);
+	free(w->slots);
+	w->slots = NULL;
+	return r;
+}
@@ -0,0 +1,61 @@
+/*
+ *  YUV4MPEG2 output
+ *
+ *  A Y4M stream describes itself: the stream header carries the size,
+ *  frame rate, interlacing and chroma layout taken from the negotiated
+ *  format, so a consumer (ffmpeg -i -, mpv -, x264 --demuxer y4m) needs
+ *  no options. YUYV is converted to planar 4:2:0 on the way, planar
+ *  4:2:0 and grey are passed as they are.
+ *
+ *  Frames are put into a small batch of slots and written with one
+ *  writev() of "FRAME\n" and payload pairs. As long as the consumer
+ *  keeps up that is one frame per call; when it falls behind, frames
+ *  collect until it can take them all at once, and only a full batch
+ *  blocks the capture.
+ */
+
+#ifndef Y4M_H
+#define Y4M_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <linux/videodev2.h>
+
+#define Y4M_BATCH_MAX	16
+
+struct y4m_writer {
+	int			fd;
+	unsigned int		width, height;
+	unsigned int		pixelformat;	/* of the input */
+	unsigned int		src_stride;
+	int			interlaced;	/* chroma per field */
+	size_t			frame_size;	/* of the Y4M payload */
+
+	unsigned char		*slots;		/* batch x frame_size */
+	unsigned int		batch;
+	unsigned int		pending;	/* frames in slots, unwritten */
+	struct iovec		iov[2 * Y4M_BATCH_MAX];
+
+	unsigned long		frames;
+	unsigned long		writes;		/* writev() calls */
+	unsigned int		max_pending;
+};
+
+/* Input formats with a Y4M layout. */
+int y4m_supported(unsigned int pixelformat);
+
+/*
+ * Write the stream header to fd. tpf may be 0/0 if the driver does not
+ * say, 30 fps is assumed then. batch: frames collected at most before
+ * the writer waits for the consumer, 1 to Y4M_BATCH_MAX.
+ */
+int y4m_open(struct y4m_writer *w, int fd, const struct v4l2_format *fmt,
+	     const struct v4l2_fract *tpf, unsigned int batch);
+
+/* One captured frame, of the format given to y4m_open(). */
+int y4m_write(struct y4m_writer *w, const void *data, size_t size);
+
+/* Write what is still pending, and free the slots. */
+int y4m_close(struct y4m_writer *w);
+
+#endif /* Y4M_H */